@@ -0,0 +1,223 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "bench.h"
+#include "sim.h"
+#include "snap.h"
+
+using namespace std;
+
+typedef chrono::steady_clock BenchClock;
+
+static double Bench_time(BenchFn fn,void *ctx,int iters) {
+    BenchClock::time_point t0 = BenchClock::now();
+    fn(ctx,iters);
+    return chrono::duration<double>(BenchClock::now()-t0).count();
+}
+
+void Bench_init(Bench *b,FILE *out,double min_sec) {
+    b->out = out;
+    b->cases = 0;
+    b->min_sec = min_sec>0 ? min_sec : 0.1;
+    fprintf(out,"{\n  \"build\": \"%s %s\",\n  \"compiler\": \"%s\",\n  \"kernel\": \"%s\",\n  \"runs\": %d,\n  \"cases\": [",
+            __DATE__,__TIME__,__VERSION__,SimBatch_kernel(),BenchRuns);
+}
+void Bench_run(Bench *b,const char *name,BenchFn fn,void *ctx,double ops) {
+    int iters = 1;
+    while(Bench_time(fn,ctx,iters)<b->min_sec/10 && iters<(1<<30)) iters *= 2;
+    iters = iters>(1<<30)/10 ? 1<<30 : iters*10;
+    double sec[BenchRuns];
+    for(int z=0;z<BenchRuns;++z) sec[z] = Bench_time(fn,ctx,iters);
+    sort(sec,sec+BenchRuns);
+    double n = ops*iters, med = sec[BenchRuns/2], best = sec[0];
+    fprintf(b->out,"%s\n    {\"name\": \"%s\", \"iters\": %d, \"ops\": %.0f, \"ns_per_op\": %.3f, "
+            "\"best_ns_per_op\": %.3f, \"ops_per_sec\": %.1f}",b->cases++ ? "," : "",name,iters,n,
+            med/n*1e9,best/n*1e9,n/med);
+    printf("%-24s %12.3f ns/op %14.1f ops/s\n",name,med/n*1e9,n/med);
+}
+void Bench_end(Bench *b) {
+    fprintf(b->out,"\n  ]\n}\n");
+    fflush(b->out);
+}
+
+// worlds flown by the same autopilot as --headless, restarted on crash
+enum EBenchSim { BenchWorlds = 4096 };
+struct BenchSim {
+    vector<SimWorld> w;
+    vector<unsigned char> act;
+    SimBatch batch;
+    SimSnapArena arena;
+    const SimVariant *var;
+    vector<SimWorld> vw; // worlds of var
+    volatile unsigned sink; // keeps results alive
+};
+static void Bench_sim_step(void *ctx,int iters) {
+    BenchSim *s = (BenchSim*) ctx;
+    SimWorld *w = &s->w[0];
+    for(int z=0;z<iters;++z) {
+        if(w->done) SimWorld_start(w,w->rng);
+        s->sink += SimWorld_step(w,SimWorld_autopilot(w));
+    }
+}
+static void Bench_sim_tick_bird(void *ctx,int iters) {
+    BenchSim *s = (BenchSim*) ctx;
+    SimWorld *w = &s->w[1];
+    for(int z=0;z<iters;++z) {
+        if(w->y>H) SimWorld_reset(w);
+        SimWorld_tick_bird(w);
+    }
+    s->sink += w->y;
+}
+static void Bench_sim_tick_scroll(void *ctx,int iters) {
+    BenchSim *s = (BenchSim*) ctx;
+    SimWorld *w = &s->w[2];
+    for(int z=0;z<iters;++z) SimWorld_tick_scroll(w);
+    s->sink += w->pipe_x[0];
+}
+// every world in a different spot, so hits and misses are mixed
+static void Bench_sim_check_hit(void *ctx,int iters) {
+    BenchSim *s = (BenchSim*) ctx;
+    for(int z=0;z<iters;++z)
+        for(int i=0;i<BenchWorlds;++i) s->sink += SimWorld_check_hit(&s->w[i]);
+}
+static void Bench_sim_batch(void *ctx,int iters) {
+    BenchSim *s = (BenchSim*) ctx;
+    SimBatch *b = &s->batch;
+    for(int z=0;z<iters;++z) {
+        for(int i=0;i<b->n;++i) {
+            if(b->done[i]) SimBatch_start(b,i,b->rng[i]);
+            s->act[i] = b->vy[i]>=0 && (b->tick[i]&7)==0;
+        }
+        SimBatch_step(b,&s->act[0]);
+    }
+    s->sink += b->point[0];
+}
+// every kernel from the same seeds for BenchCheckTicks ticks, flapping and
+// restarting like Bench_sim_batch, must leave the batch arrays bit-identical
+// to the scalar kernel, and scalar to SimWorld_step; returns the kernels
+// that differ
+enum EBenchCheck { BenchCheckTicks = 2000 };
+static const char *BenchKernels[] = {"scalar","sse2","avx2"};
+static void Bench_sim_batch_fly(SimBatch *b,unsigned char *act) {
+    for(int i=0;i<b->n;++i) SimBatch_start(b,i,i+1);
+    for(int z=0;z<BenchCheckTicks;++z) {
+        for(int i=0;i<b->n;++i) {
+            if(b->done[i]) SimBatch_start(b,i,b->rng[i]);
+            act[i] = b->vy[i]>=0 && (b->tick[i]&7)==0;
+        }
+        SimBatch_step(b,act);
+    }
+}
+// the same flight through SimWorld_step, stored into b at the end
+static void Bench_sim_world_fly(SimBatch *b,unsigned char *act,SimWorld *w) {
+    for(int i=0;i<b->n;++i) SimWorld_start(w+i,i+1);
+    for(int z=0;z<BenchCheckTicks;++z) {
+        for(int i=0;i<b->n;++i) {
+            if(w[i].done) SimWorld_start(w+i,w[i].rng);
+            act[i] = w[i].vy>=0 && (w[i].tick&7)==0;
+        }
+        for(int i=0;i<b->n;++i) b->ev[i] = SimWorld_step(w+i,act[i]!=0);
+    }
+    for(int i=0;i<b->n;++i) {
+        int ev = b->ev[i];
+        SimBatch_set(b,i,w+i);
+        b->ev[i] = ev;
+    }
+}
+static int Bench_sim_batch_check(BenchSim *s) {
+    const char *was = SimBatch_kernel();
+    const size_t size = (size_t)(9+2*SimPipes)*BenchWorlds*sizeof(int); // every array, see SimBatch_init
+    SimBatch ref;
+    SimBatch_init(&ref,BenchWorlds);
+    SimBatch_use_kernel("scalar");
+    Bench_sim_batch_fly(&ref,&s->act[0]);
+    int bad = 0;
+    vector<SimWorld> w(BenchWorlds);
+    Bench_sim_world_fly(&s->batch,&s->act[0],&w[0]);
+    if(memcmp(ref.mem,s->batch.mem,size)) {
+        printf("SimBatch kernel scalar differs from SimWorld_step after %d ticks\n",(int)BenchCheckTicks);
+        ++bad;
+    }
+    for(int z=1;z<3;++z) {
+        if(!SimBatch_use_kernel(BenchKernels[z])) continue;
+        Bench_sim_batch_fly(&s->batch,&s->act[0]);
+        if(memcmp(ref.mem,s->batch.mem,size)) {
+            printf("SimBatch kernel %s differs from scalar after %d ticks\n",BenchKernels[z],(int)BenchCheckTicks);
+            ++bad;
+        }
+    }
+    SimBatch_use_kernel(was);
+    SimBatch_destroy(&ref);
+    return bad;
+}
+// one search branch: save, roll out a few ticks, restore
+static void Bench_sim_snap(void *ctx,int iters) {
+    BenchSim *s = (BenchSim*) ctx;
+    SimWorld *w = &s->w[3];
+    for(int z=0;z<iters;++z) {
+        if((z&1023)==0) SimSnapArena_reset(&s->arena);
+        SimSnap *snap = SimSnapArena_save(&s->arena,w);
+        for(int k=0;k<8;++k) SimWorld_step(w,k==0);
+        s->sink += w->y;
+        SimSnap_load(snap,w);
+    }
+}
+// one tick of every world through the variant table, the dispatch is paid
+// once per batch
+static void Bench_sim_variant(void *ctx,int iters) {
+    BenchSim *s = (BenchSim*) ctx;
+    const SimVariant *v = s->var;
+    SimWorld *w = &s->vw[0];
+    for(int z=0;z<iters;++z) {
+        for(int i=0;i<BenchWorlds;++i) {
+            if(w[i].done) v->start(w+i,w[i].rng);
+            s->act[i] = v->autopilot(w+i);
+        }
+        v->step_batch(w,&s->act[0],BenchWorlds);
+    }
+    s->sink += w[0].point;
+}
+int Bench_sim(Bench *b) {
+    BenchSim s;
+    s.w.resize(BenchWorlds);
+    s.act.resize(BenchWorlds);
+    s.sink = 0;
+    for(int i=0;i<BenchWorlds;++i) {
+        SimWorld_start(&s.w[i],i+1);
+        int n = i%97;
+        for(int k=0;k<n && !s.w[i].done;++k) SimWorld_step(&s.w[i],SimWorld_autopilot(&s.w[i]));
+        s.w[i].done = false;
+    }
+    Bench_run(b,"sim_step",Bench_sim_step,&s,1);
+    Bench_run(b,"sim_tick_bird",Bench_sim_tick_bird,&s,1);
+    Bench_run(b,"sim_tick_scroll",Bench_sim_tick_scroll,&s,1);
+    Bench_run(b,"sim_check_hit",Bench_sim_check_hit,&s,BenchWorlds);
+    SimSnapArena_init(&s.arena,1024);
+    Bench_run(b,"sim_snap_branch8",Bench_sim_snap,&s,1);
+    SimSnapArena_destroy(&s.arena);
+    s.vw.resize(BenchWorlds);
+    for(int z=0;z<SimVariantCount;++z) {
+        char name[32];
+        snprintf(name,sizeof(name),"variant_step_%s",SimVariants[z].name);
+        s.var = SimVariants+z;
+        for(int i=0;i<BenchWorlds;++i) s.var->start(&s.vw[i],i+1);
+        Bench_run(b,name,Bench_sim_variant,&s,BenchWorlds);
+    }
+    SimBatch_init(&s.batch,BenchWorlds);
+    int bad = Bench_sim_batch_check(&s);
+    const char *was = SimBatch_kernel();
+    for(int z=0;z<3;++z) {
+        if(!SimBatch_use_kernel(BenchKernels[z])) continue;
+        char name[32];
+        snprintf(name,sizeof(name),"batch_step_%s",BenchKernels[z]);
+        for(int i=0;i<BenchWorlds;++i) SimBatch_start(&s.batch,i,i+1);
+        Bench_run(b,name,Bench_sim_batch,&s,BenchWorlds);
+    }
+    SimBatch_use_kernel(was);
+    SimBatch_destroy(&s.batch);
+    return bad;
+}
@@ -0,0 +1,27 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+
+// benchmark runner
+// every case is calibrated to BenchMinSec, then timed BenchRuns times,
+// results are written as one JSON document so builds can be compared
+enum EBench { BenchRuns = 5 };
+struct Bench {
+    FILE *out;
+    int cases;
+    double min_sec;
+};
+// fn runs the measured operation iters times
+typedef void (*BenchFn)(void *ctx,int iters);
+
+void Bench_init(Bench *b,FILE *out,double min_sec);
+// ops: operations done by one iteration, e.g. worlds stepped
+void Bench_run(Bench *b,const char *name,BenchFn fn,void *ctx,double ops);
+void Bench_end(Bench *b);
+// headless cases: SimWorld step and its parts, collision, snapshot
+// branching, every SimVariant, SimBatch kernels; returns the SimBatch
+// kernels that are not bit-identical to scalar
+int Bench_sim(Bench *b);
+
+#endif // BENCH_H
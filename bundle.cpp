@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "bundle.h"
+
+static const unsigned BundleVersion = 1;
+static const unsigned BundleMaxSide = 1<<14; // pixels, keeps w*h*4 far from overflowing
+
+// the data of an entry must match its header: whole RGBA32 rows of w*h
+// pixels, whole PCM frames of the stored format and channels
+static bool Bundle_entry_ok(const BundleEntry *e) {
+    if(e->kind==BkPixels)
+        return e->w && e->h && e->w<=BundleMaxSide && e->h<=BundleMaxSide
+            && (unsigned long long)e->w*e->h*4<=e->size;
+    if(e->kind==BkPcm) {
+        unsigned frame = ((e->h>>8)&0xff)/8*(e->h&0xff); // sample bits of the SDL format, channels
+        return frame && e->size%frame==0;
+    }
+    return true;
+}
+
+#ifdef _WIN32
+static const void *Bundle_map(const char *path,size_t *size,void **map) {
+    HANDLE f = CreateFileA(path,GENERIC_READ,FILE_SHARE_READ,0,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,0);
+    if(f==INVALID_HANDLE_VALUE) return 0;
+    LARGE_INTEGER len;
+    GetFileSizeEx(f,&len);
+    HANDLE m = CreateFileMappingA(f,0,PAGE_READONLY,0,0,0);
+    CloseHandle(f);
+    if(!m) return 0;
+    const void *p = MapViewOfFile(m,FILE_MAP_READ,0,0,0);
+    if(!p) {
+        CloseHandle(m);
+        return 0;
+    }
+    *size = (size_t)len.QuadPart;
+    *map = m;
+    return p;
+}
+static void Bundle_unmap(const void *p,size_t,void *map) {
+    UnmapViewOfFile(p);
+    CloseHandle((HANDLE)map);
+}
+#else
+static const void *Bundle_map(const char *path,size_t *size,void **map) {
+    int fd = open(path,O_RDONLY);
+    if(fd<0) return 0;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if(!fstat(fd,&st) && st.st_size>0) p = mmap(0,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if(p==MAP_FAILED) return 0;
+    *size = st.st_size;
+    *map = 0;
+    return p;
+}
+static void Bundle_unmap(const void *p,size_t size,void *) {
+    munmap((void*)p,size);
+}
+#endif
+
+bool Bundle_open(Bundle *b,const char *path) {
+    memset(b,0,sizeof(Bundle));
+    b->data = (const unsigned char*) Bundle_map(path,&b->size,&b->map);
+    if(!b->data) return false;
+    const BundleHeader *h = (const BundleHeader*) b->data;
+    bool ok = b->size>=sizeof(BundleHeader) && !memcmp(h->magic,"FPAK",4)
+            && h->version==BundleVersion && h->size==b->size
+            && h->count<=(b->size-sizeof(BundleHeader))/sizeof(BundleEntry);
+    for(unsigned z=0;ok && z<h->count;++z) {
+        const BundleEntry *e = (const BundleEntry*)(h+1)+z;
+        ok = e->offset<=b->size && e->size<=b->size-e->offset && e->name[sizeof(e->name)-1]==0
+                && Bundle_entry_ok(e);
+    }
+    if(!ok) {
+        printf("Ignoring damaged bundle %s\n",path);
+        Bundle_close(b);
+        return false;
+    }
+    b->index = (const BundleEntry*)(h+1);
+    b->count = h->count;
+    return true;
+}
+void Bundle_close(Bundle *b) {
+    if(b->data) Bundle_unmap(b->data,b->size,b->map);
+    memset(b,0,sizeof(Bundle));
+}
+const BundleEntry *Bundle_find(const Bundle *b,const char *dir,const char *name) {
+    char key[sizeof(((BundleEntry*)0)->name)];
+    snprintf(key,sizeof(key),"%s/%s",dir,name);
+    for(unsigned z=0;z<b->count;++z)
+        if(!strcmp(b->index[z].name,key)) return b->index+z;
+    return 0;
+}
+const void *Bundle_data(const Bundle *b,const BundleEntry *e) {
+    return b->data+e->offset;
+}
+
+void BundleWriter_add(BundleWriter *w,const char *dir,const char *name,unsigned kind,
+                      unsigned ew,unsigned eh,const void *data,size_t size) {
+    BundleEntry e;
+    memset(&e,0,sizeof(e));
+    snprintf(e.name,sizeof(e.name),"%s/%s",dir,name);
+    e.kind = kind;
+    e.w = ew;
+    e.h = eh;
+    w->data.resize((w->data.size()+15)&~(size_t)15);
+    e.offset = w->data.size(); // relative to the data block until saved
+    e.size = size;
+    w->data.insert(w->data.end(),(const unsigned char*)data,(const unsigned char*)data+size);
+    w->index.push_back(e);
+}
+bool BundleWriter_save(const BundleWriter *w,const char *path) {
+    size_t head = sizeof(BundleHeader)+w->index.size()*sizeof(BundleEntry);
+    size_t base = (head+15)&~(size_t)15;
+    BundleHeader h;
+    memcpy(h.magic,"FPAK",4);
+    h.version = BundleVersion;
+    h.count = w->index.size();
+    h.size = base+w->data.size();
+    std::vector<BundleEntry> index = w->index;
+    for(size_t z=0;z<index.size();++z) index[z].offset += base;
+    FILE *f = fopen(path,"wb");
+    if(!f) return false;
+    static const unsigned char pad[16] = {0};
+    bool ok = fwrite(&h,sizeof(h),1,f)==1
+            && (index.empty() || fwrite(&index[0],sizeof(BundleEntry),index.size(),f)==index.size())
+            && fwrite(pad,1,base-head,f)==base-head
+            && (w->data.empty() || fwrite(&w->data[0],1,w->data.size(),f)==w->data.size());
+    return fclose(f)==0 && ok;
+}
@@ -0,0 +1,43 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <stddef.h>
+
+#include <vector>
+
+// packed asset bundle
+// file: BundleHeader, count BundleEntry, then 16-byte aligned data
+// the file is memory mapped and entries are handed out as pointers into
+// the mapping, nothing is copied or decoded at startup
+enum EBk { BkRaw, BkPixels, BkPcm };
+struct BundleHeader {
+    char magic[4]; // "FPAK"
+    unsigned version, count, size;
+};
+struct BundleEntry {
+    char name[40]; // "i/avatar.png"
+    unsigned kind; // EBk
+    unsigned w, h; // BkPixels: RGBA32 size, BkPcm: frequency, format<<8|channels
+    unsigned offset, size;
+};
+struct Bundle {
+    const unsigned char *data;
+    size_t size;
+    const BundleEntry *index;
+    unsigned count;
+    void *map; // platform handle
+};
+bool Bundle_open(Bundle *b,const char *path);
+void Bundle_close(Bundle *b);
+const BundleEntry *Bundle_find(const Bundle *b,const char *dir,const char *name);
+const void *Bundle_data(const Bundle *b,const BundleEntry *e);
+
+struct BundleWriter {
+    std::vector<BundleEntry> index;
+    std::vector<unsigned char> data;
+};
+void BundleWriter_add(BundleWriter *w,const char *dir,const char *name,unsigned kind,
+                      unsigned ew,unsigned eh,const void *data,size_t size);
+bool BundleWriter_save(const BundleWriter *w,const char *path);
+
+#endif // BUNDLE_H
@@ -3,11 +3,62 @@ CONFIG += console
 CONFIG -= app_bundle
 CONFIG -= qt
 
-SOURCES += main.cpp
+SOURCES += main.cpp \
+    sim.cpp \
+    sim_batch.cpp \
+    sim_pool.cpp \
+    replay.cpp \
+    bundle.cpp \
+    profiler.cpp \
+    bench.cpp \
+    obs.cpp \
+    raster.cpp \
+    snap.cpp \
+    sound_queue.cpp \
+    spectate.cpp \
+    metrics.cpp
+
+HEADERS += sim.h \
+    sim_pool.h \
+    replay.h \
+    bundle.h \
+    profiler.h \
+    bench.h \
+    obs.h \
+    raster.h \
+    flappy_env.h \
+    snap.h \
+    sound_queue.h \
+    sim_core.h \
+    spectate.h \
+    metrics.h
 
 win32:INCLUDEPATH +=  C:/Software/SDL/include
 
-win32:LIBS += -LC:/Software/SDL/lib -lmingw32 -mwindows -mconsole -lSDL2main -lSDL2 -lSDL2_image -lSDL2_mixer -lSDL2_ttf
-unix:LIBS += -L/usr/lib -lSDL2 -lSDL2_image -lSDL2_mixer -lSDL2_ttf
+win32:LIBS += -LC:/Software/SDL/lib -lmingw32 -mwindows -mconsole -lSDL2main -lSDL2 -lSDL2_image -lSDL2_mixer -lSDL2_ttf -lSDL2_net
+unix:LIBS += -L/usr/lib -lSDL2 -lSDL2_image -lSDL2_mixer -lSDL2_ttf -lSDL2_net -lpthread
 
 QMAKE_CXXFLAGS += -std=c++11
+
+# qmake CONFIG+=mute: no sound device and no SDL_mixer call, for headless runs
+mute: DEFINES += FLAPPY_MUTE
+
+# decoded asset bundle, mapped at startup instead of loading i/ a/ f/
+pack.target = flappy.pak
+pack.depends = $(TARGET)
+pack.commands = ./$(TARGET) --pack flappy.pak
+QMAKE_EXTRA_TARGETS += pack
+
+# benchmark suite, results in bench.json
+bench.depends = $(TARGET)
+bench.commands = ./$(TARGET) --bench bench.json
+QMAKE_EXTRA_TARGETS += bench
+
+# batch environment for python (flappy_env.py), shares the headless objects
+envobj.target = flappy_env.o
+envobj.depends = flappy_env.cpp flappy_env.h bundle.h raster.h obs.h sim.h sim_pool.h
+envobj.commands = $(CXX) -c $(CXXFLAGS) $(INCPATH) -o flappy_env.o flappy_env.cpp
+env.target = libflappy.so
+env.depends = flappy_env.o sim.o sim_batch.o sim_pool.o obs.o raster.o bundle.o metrics.o
+env.commands = $(LINK) -shared -o libflappy.so $$env.depends -lpthread
+QMAKE_EXTRA_TARGETS += envobj env
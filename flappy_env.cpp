@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "flappy_env.h"
+#include "bundle.h"
+#include "raster.h"
+#include "sim_pool.h"
+
+struct FlappyEnv {
+    SimBatch b;
+    SimPool pool;
+    Raster r;
+    bool pixels;
+    int *point; // score before the step, for the reward
+    // buffers of the current call
+    const unsigned char *actions;
+    unsigned char *obs, *done;
+    float *state, *reward;
+};
+
+// bird y, bird vy, distance to the next pipe, gap centre relative to the
+// bird centre, scaled to about -1..1
+static void FlappyEnv_state(const SimBatch *b,int i,float *s) {
+    int next = W, up = H/2;
+    for(int z=0;z<SimPipes;++z) {
+        int x = b->pipe_x[z][i];
+        if(x+SimPipeW>SimBirdX && x<next) {
+            next = x;
+            up = b->pipe_up[z][i];
+        }
+    }
+    s[0] = (float)b->y[i]/H;
+    s[1] = (float)b->vy[i]/-SimJump;
+    s[2] = (float)(next-SimBirdX)/W;
+    s[3] = (float)(up+SimSpace/2-b->y[i]-SimBirdH/2)/H;
+}
+static void FlappyEnv_observe(FlappyEnv *e,int i) {
+    if(e->state) FlappyEnv_state(&e->b,i,e->state+i*FlappyEnvState);
+    if(!e->obs || !e->pixels) return;
+    SimWorld w;
+    SimBatch_get(&e->b,i,&w);
+    int ch = e->r.spec.gray ? 1 : 4;
+    ObsFrame f = {e->obs+(size_t)i*FlappyEnv_obs_size(e),e->r.spec.w,e->r.spec.h,e->r.spec.w*ch,ch,w.tick};
+    Raster_draw(&e->r,&w,&f);
+}
+static void FlappyEnv_reset_chunk(void *ctx,int from,int to) {
+    FlappyEnv *e = (FlappyEnv*) ctx;
+    for(int i=from;i<to;++i) FlappyEnv_observe(e,i);
+}
+static void FlappyEnv_step_chunk(void *ctx,int from,int to) {
+    FlappyEnv *e = (FlappyEnv*) ctx;
+    SimBatch *b = &e->b;
+    SimBatch_step_range(b,e->actions,from,to);
+    for(int i=from;i<to;++i) {
+        if(e->reward) e->reward[i] = b->point[i]-e->point[i];
+        if(e->done) e->done[i] = b->done[i]!=0;
+        if(b->done[i]) SimBatch_start(b,i,b->rng[i]); // next episode, new seed
+        e->point[i] = b->point[i];
+        FlappyEnv_observe(e,i);
+    }
+}
+
+FlappyEnv *FlappyEnv_create(int n,const char *pak,int obs_w,int obs_h,int gray,int threads) {
+    if(n<1) return 0;
+    FlappyEnv *e = new FlappyEnv();
+    e->pixels = pak && obs_w>0 && obs_h>0;
+    if(e->pixels) {
+        Bundle bu;
+        RasterImage img[RsTotal];
+        ObsSpec spec = {obs_w,obs_h,gray!=0};
+        bool ok = Bundle_open(&bu,pak) && Raster_bundle_images(&bu,img) && Raster_init(&e->r,&spec,img);
+        Bundle_close(&bu); // sprites are copied by Raster_init
+        if(!ok) {
+            delete e;
+            return 0;
+        }
+    }
+    SimBatch_init(&e->b,n);
+    SimPool_init(&e->pool,threads,256);
+    e->point = (int*) calloc(n,sizeof(int));
+    FlappyEnv_reset(e,1,0,0);
+    return e;
+}
+void FlappyEnv_destroy(FlappyEnv *e) {
+    if(!e) return;
+    free(e->point);
+    SimPool_destroy(&e->pool);
+    SimBatch_destroy(&e->b);
+    if(e->pixels) Raster_destroy(&e->r);
+    delete e;
+}
+int FlappyEnv_size(const FlappyEnv *e) {
+    return e->b.n;
+}
+int FlappyEnv_obs_size(const FlappyEnv *e) {
+    return e->pixels ? e->r.spec.w*e->r.spec.h*(e->r.spec.gray ? 1 : 4) : 0;
+}
+void FlappyEnv_reset(FlappyEnv *e,unsigned seed,unsigned char *obs,float *state) {
+    for(int i=0;i<e->b.n;++i) {
+        SimBatch_start(&e->b,i,seed+i);
+        e->point[i] = 0;
+    }
+    e->obs = obs;
+    e->state = state;
+    SimPool_for(&e->pool,e->b.n,FlappyEnv_reset_chunk,e);
+}
+void FlappyEnv_step(FlappyEnv *e,const unsigned char *actions,unsigned char *obs,
+                    float *state,float *reward,unsigned char *done) {
+    e->actions = actions;
+    e->obs = obs;
+    e->state = state;
+    e->reward = reward;
+    e->done = done;
+    SimPool_for(&e->pool,e->b.n,FlappyEnv_step_chunk,e);
+}
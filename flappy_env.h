@@ -0,0 +1,38 @@
+#ifndef FLAPPY_ENV_H
+#define FLAPPY_ENV_H
+
+// batch environment for training, built as libflappy.so (make libflappy.so)
+// plain C interface for ctypes: every buffer is allocated by the caller,
+// contiguous with one row per world, so numpy arrays are passed without
+// copies and a step allocates nothing
+// obs: uint8 [n][h][w] gray or [n][h][w][4] RGBA, drawn by Raster from the
+//      sprites in flappy.pak
+// state: float32 [n][FlappyEnvState], see FlappyEnv_state
+// reward: float32 [n], pipes passed this step
+// done: uint8 [n], a finished world restarts right away, so its obs and
+//       state already show the first tick of the next episode
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum EFlappyEnv { FlappyEnvState = 4 };
+typedef struct FlappyEnv FlappyEnv;
+
+// pak 0 or obs_w<=0: no pixel observations; threads<=0 uses every core
+// 0 when flappy.pak can't be read or its sprites don't fit the simulation
+FlappyEnv *FlappyEnv_create(int n,const char *pak,int obs_w,int obs_h,int gray,int threads);
+void FlappyEnv_destroy(FlappyEnv *e);
+int FlappyEnv_size(const FlappyEnv *e);
+int FlappyEnv_obs_size(const FlappyEnv *e); // bytes per world, 0 without pixels
+// every world starts a new episode, world i from seed+i
+void FlappyEnv_reset(FlappyEnv *e,unsigned seed,unsigned char *obs,float *state);
+// actions[i]!=0 flaps world i, every pointer but actions may be 0
+void FlappyEnv_step(FlappyEnv *e,const unsigned char *actions,unsigned char *obs,
+                    float *state,float *reward,unsigned char *done);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FLAPPY_ENV_H
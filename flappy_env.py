@@ -0,0 +1,61 @@
+"""numpy wrapper for libflappy.so (make libflappy.so)
+
+The arrays are allocated once and filled in place by the library, every
+reset/step returns the same arrays, copy them to keep old values.
+"""
+import ctypes
+import os
+
+import numpy as np
+
+STATE = 4  # FlappyEnvState
+
+
+class FlappyEnv:
+    def __init__(self, n, pak=None, obs_w=0, obs_h=0, gray=True, threads=0, lib=None):
+        path = lib or os.path.join(os.path.dirname(os.path.abspath(__file__)), 'libflappy.so')
+        L = self.lib = ctypes.CDLL(path)
+        p = ctypes.c_void_p
+        L.FlappyEnv_create.restype = p
+        L.FlappyEnv_create.argtypes = [ctypes.c_int, ctypes.c_char_p, ctypes.c_int, ctypes.c_int,
+                                       ctypes.c_int, ctypes.c_int]
+        L.FlappyEnv_destroy.argtypes = [p]
+        L.FlappyEnv_obs_size.argtypes = [p]
+        L.FlappyEnv_reset.argtypes = [p, ctypes.c_uint, p, p]
+        L.FlappyEnv_step.argtypes = [p, p, p, p, p, p]
+        self.env = L.FlappyEnv_create(n, pak.encode() if pak else None, obs_w, obs_h, int(gray), threads)
+        if not self.env:
+            raise RuntimeError('cannot create FlappyEnv from %r' % pak)
+        self.n = n
+        self.obs = None
+        if L.FlappyEnv_obs_size(self.env):
+            shape = (n, obs_h, obs_w) if gray else (n, obs_h, obs_w, 4)
+            self.obs = np.zeros(shape, np.uint8)
+        self.state = np.zeros((n, STATE), np.float32)
+        self.reward = np.zeros(n, np.float32)
+        self.done = np.zeros(n, np.uint8)
+        self.actions = np.zeros(n, np.uint8)
+
+    @staticmethod
+    def _ptr(a):
+        return None if a is None else a.ctypes.data
+
+    def reset(self, seed=1):
+        """every world starts a new episode, world i from seed+i"""
+        self.lib.FlappyEnv_reset(self.env, seed, self._ptr(self.obs), self._ptr(self.state))
+        return self.obs, self.state
+
+    def step(self, actions):
+        """actions: n values, nonzero flaps; finished worlds restart at once"""
+        self.actions[:] = actions
+        self.lib.FlappyEnv_step(self.env, self._ptr(self.actions), self._ptr(self.obs),
+                                self._ptr(self.state), self._ptr(self.reward), self._ptr(self.done))
+        return self.obs, self.state, self.reward, self.done
+
+    def close(self):
+        if self.env:
+            self.lib.FlappyEnv_destroy(self.env)
+            self.env = None
+
+    def __del__(self):
+        self.close()
@@ -1,13 +1,28 @@
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 #include <SDL2/SDL_mixer.h>
 #include <SDL2/SDL_ttf.h>
 
+#include <atomic>
+#include <thread>
 #include <vector>
 
+#include "sim.h"
+#include "sim_pool.h"
+#include "replay.h"
+#include "bundle.h"
+#include "profiler.h"
+#include "bench.h"
+#include "obs.h"
+#include "raster.h"
+#include "sound_queue.h"
+#include "spectate.h"
+#include "metrics.h"
+
 #include <sys/types.h>  // stat()
 #include <sys/stat.h>
 
@@ -22,8 +37,6 @@
 
 using namespace std;
 
-const int W = 400, H = 400;
-
 void error1(const char what[]) {
     printf("%s: %s\n",what ,SDL_GetError() );
     exit(1);
@@ -66,46 +79,74 @@ const SDL_Color ClWhite = {255,255,255,0};
 const SDL_Color ClBlack = {0,0,0,0};
 const SDL_Color ClDarkBlue = {0,0,128,0};
 
+int TextureUploads = 0; // SDL_CreateTextureFromSurface calls, for the profiler
+
+// SpriteBatch struct
+// quads are queued and sent with one SDL_RenderGeometry per run of the same
+// texture, so sprites and text from two atlases cost a few calls per frame
+enum ESb { SbMaxQuads = 1024 };
+struct SpriteBatch {
+    SDL_Renderer *ren;
+    SDL_Texture *tex; // texture of the queued quads
+    int tex_w, tex_h;
+    int n; // queued quads
+    int calls; // draw calls this frame
+    SDL_Vertex vert[SbMaxQuads*4];
+    int idx[SbMaxQuads*6];
+};
+void SpriteBatch_init(SpriteBatch *sb,SDL_Renderer *ren) {
+    sb->ren = ren;
+    sb->tex = 0;
+    sb->n = sb->calls = 0;
+    for(int z=0;z<SbMaxQuads;++z) { // two triangles per quad
+        static const int quad[6] = {0,1,2,2,1,3};
+        for(int k=0;k<6;++k) sb->idx[z*6+k] = z*4+quad[k];
+    }
+}
+void SpriteBatch_flush(SpriteBatch *sb) {
+    if(!sb->n) return;
+    SDL_RenderGeometry(sb->ren,sb->tex,sb->vert,sb->n*4,sb->idx,sb->n*6);
+    sb->n = 0;
+    ++sb->calls;
+}
+// s in texture pixels, drawn unscaled or stretched to d
+void SpriteBatch_quad(SpriteBatch *sb,SDL_Texture *tex,int tw,int th,const SDL_Rect &s,const SDL_Rect &d,const SDL_Color &cl) {
+    if(s.w<=0 || s.h<=0 || d.w<=0 || d.h<=0) return;
+    if(tex!=sb->tex || sb->n==SbMaxQuads) {
+        SpriteBatch_flush(sb);
+        sb->tex = tex;
+        sb->tex_w = tw;
+        sb->tex_h = th;
+    }
+    float sw = 1.0f/tw, sh = 1.0f/th;
+    SDL_Vertex *v = sb->vert+sb->n*4;
+    for(int k=0;k<4;++k) {
+        v[k].position.x = d.x + (k&1 ? d.w : 0);
+        v[k].position.y = d.y + (k&2 ? d.h : 0);
+        v[k].color = cl;
+        v[k].tex_coord.x = (s.x + (k&1 ? s.w : 0))*sw;
+        v[k].tex_coord.y = (s.y + (k&2 ? s.h : 0))*sh;
+    }
+    ++sb->n;
+}
+
 // Texture struct
+// a sprite inside the TextureManager atlas
 struct Tex {
     SDL_Rect pos;
-    SDL_Texture *tex;
-    SDL_Renderer* ren;
+    SDL_Rect src; // region in the atlas
+    SDL_Texture *tex; // the atlas, shared
+    int tex_w, tex_h;
+    SpriteBatch *batch;
 };
-void Tex_destroy(Tex *te) {
-    if(te->tex) SDL_DestroyTexture(te->tex); // ~4
-    te->tex = 0;
-}
-void Tex_load_at(Tex *te,TTF_Font *font,const char str[],const SDL_Color &fg,SDL_Renderer *ren,int x,int y) {
-    Tex_destroy(te);
-    te->ren = ren;
-    SDL_Surface *img = TTF_RenderText_Solid(font,str,fg); // ~4
-    if(!img) error2("Failed to render text",str);
-    te->tex = SDL_CreateTextureFromSurface(ren, img); // 3
-    SDL_FreeSurface(img); // ~4
-    if(!te->tex) error2("Failed to create texture from text",str);
-    SDL_QueryTexture(te->tex,0,0,&te->pos.w,&te->pos.h);
-    te->pos.x = x;
-    te->pos.y = y;
-}
-void Tex_load(Tex *te,const char path[],SDL_Renderer *ren) {
-    Tex_destroy(te);
-    te->ren = ren;
-    te->pos.x = 0;
-    te->pos.y = 0;
-    SDL_RWops *rwop = SDL_RWFromFile(path, "rb");
-    SDL_Surface *img = IMG_LoadPNG_RW(rwop); // 4
-    if(!img) error2("Failed to load",path);
-    te->tex = SDL_CreateTextureFromSurface(ren, img); // 3
-    SDL_FreeSurface(img); // ~4
-    if(!te->tex) error2("Failed to create texture from",path);
-    SDL_QueryTexture(te->tex,0,0,&te->pos.w,&te->pos.h);
-}
+const SDL_Color ClOpaque = {255,255,255,255};
 void Tex_draw(Tex *te) {
-    SDL_RenderCopy(te->ren, te->tex, 0, &te->pos);
+    SpriteBatch_quad(te->batch,te->tex,te->tex_w,te->tex_h,te->src,te->pos,ClOpaque);
 }
+// s is relative to the sprite and must stay inside it
 void Tex_draw(Tex *te,SDL_Rect *s,SDL_Rect *d) {
-    SDL_RenderCopy(te->ren, te->tex, s, d);
+    SDL_Rect a = {te->src.x+s->x,te->src.y+s->y,s->w,s->h};
+    SpriteBatch_quad(te->batch,te->tex,te->tex_w,te->tex_h,a,*d,ClOpaque);
 }
 void Tex_set_xy(Tex *te,int x, int y) {
     te->pos.x = x;
@@ -123,36 +164,106 @@ SDL_Rect *Tex_pos(Tex *te) {
 
 
 // TextureManager struct
+// every image is packed into one atlas texture at load time
 enum ETx { TxBird, TxBG, TxEnd, TxReady, TxGround, TxInstruct, TxBPipe, TxTPipe, TxTotal};
+enum ETxAtlas { TxAtlasW = 512, TxAtlasPad = 1 };
+const char TxFiles[TxTotal][24] = { // urutan harus sama dengan enum I_Tex
+                                    "avatar.png",
+                                    "background.png",
+                                    "gameover.png",
+                                    "getready.png",
+                                    "ground.png",
+                                    "instructions.png",
+                                    "obstacle_bottom.png",
+                                    "obstacle_top.png"
+                                  };
 struct TextureManager {
     Tex tx[TxTotal];
+    SDL_Texture *atlas;
+    SpriteBatch batch;
     SDL_Renderer *ren;
 };
-void TextureManager_init(TextureManager *tm,AbsPath *folder, SDL_Window *win) {
+SDL_Surface *TextureManager_load(const char path[]) {
+    SDL_RWops *rwop = SDL_RWFromFile(path, "rb");
+    if(!rwop) error2("Failed to open",path);
+    SDL_Surface *img = IMG_LoadPNG_RW(rwop); // 4
+    SDL_RWclose(rwop);
+    if(!img) error2("Failed to load",path);
+    return img;
+}
+// shelf packing, tallest first
+void TextureManager_pack(TextureManager *tm,SDL_Surface *img[TxTotal]) {
+    int order[TxTotal];
+    for(int z=0;z<TxTotal;++z) order[z] = z;
+    for(int z=1;z<TxTotal;++z)
+        for(int k=z;k>0 && img[order[k]]->h>img[order[k-1]]->h;--k) {
+            int t = order[k];
+            order[k] = order[k-1];
+            order[k-1] = t;
+        }
+    int x = 0, y = 0, row = 0;
+    for(int z=0;z<TxTotal;++z) {
+        Tex *te = &tm->tx[order[z]];
+        int w = img[order[z]]->w, h = img[order[z]]->h;
+        if(x+w>TxAtlasW) {
+            x = 0;
+            y += row+TxAtlasPad;
+            row = 0;
+        }
+        SDL_Rect_set_xywh(&te->src,x,y,w,h);
+        SDL_Rect_set_xywh(&te->pos,0,0,w,h);
+        x += w+TxAtlasPad;
+        if(h>row) row = h;
+    }
+    SDL_Surface *atlas = SDL_CreateRGBSurfaceWithFormat(0,TxAtlasW,y+row,32,SDL_PIXELFORMAT_RGBA32); // 5
+    if(!atlas) error1("Failed to create texture atlas");
+    for(int z=0;z<TxTotal;++z) {
+        SDL_SetSurfaceBlendMode(img[z],SDL_BLENDMODE_NONE); // copy alpha as is
+        SDL_BlitSurface(img[z],0,atlas,&tm->tx[z].src);
+    }
+    tm->atlas = SDL_CreateTextureFromSurface(tm->ren,atlas); // 3
+    ++TextureUploads;
+    SDL_FreeSurface(atlas); // ~5
+    if(!tm->atlas) error1("Failed to create texture atlas");
+    SDL_SetTextureBlendMode(tm->atlas,SDL_BLENDMODE_BLEND);
+    for(int z=0;z<TxTotal;++z) {
+        tm->tx[z].tex = tm->atlas;
+        tm->tx[z].tex_w = TxAtlasW;
+        tm->tx[z].tex_h = y+row;
+        tm->tx[z].batch = &tm->batch;
+    }
+}
+// IMG_Init stays on the main thread, decoding may run on any thread
+void TextureManager_init(TextureManager *tm) {
     memset(tm,0,sizeof(TextureManager));
-    tm->ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED|SDL_RENDERER_PRESENTVSYNC); // 1
-    if (!tm->ren) error1("SDL_CreateRenderer Error");
     int flag = IMG_INIT_PNG|IMG_INIT_JPG;
     if( (IMG_Init(flag) & flag) != flag ) // 2
         error1("Failed to init PNG and JPG support");
-    static const char files[TxTotal][24] = { // urutan harus sama dengan enum I_Tex
-                                             "avatar.png",
-                                             "background.png",
-                                             "gameover.png",
-                                             "getready.png",
-                                             "ground.png",
-                                             "instructions.png",
-                                             "obstacle_bottom.png",
-                                             "obstacle_top.png"
-                                           };
-    AbsPath_setSuffix(folder,"/i/");
-    for(int z=0;z<TxTotal;++z) {
-        if(!AbsPath_cat(folder,files[z],"image"))
-            error2("File does not exists",folder->path);
-        Tex_load(&tm->tx[z],folder->path,tm->ren);
+}
+// software renderer into screen when there is no window
+void TextureManager_open(TextureManager *tm,SDL_Window *win,SDL_Surface *screen) {
+    if(win) tm->ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED|SDL_RENDERER_PRESENTVSYNC); // 1
+    else tm->ren = SDL_CreateSoftwareRenderer(screen); // 1
+    if (!tm->ren) error1("SDL_CreateRenderer Error");
+    SpriteBatch_init(&tm->batch,tm->ren);
+}
+// path is only read when the bundle lacks the image
+SDL_Surface *TextureManager_decode(const Bundle *pak,int z,const char path[]) {
+    const BundleEntry *e = Bundle_find(pak,"i",TxFiles[z]);
+    if(e && e->kind==BkPixels) { // decoded already, points into the mapping
+        SDL_Surface *img = SDL_CreateRGBSurfaceWithFormatFrom((void*)Bundle_data(pak,e),e->w,e->h,32,e->w*4,SDL_PIXELFORMAT_RGBA32); // 4
+        if(!img) error2("Failed to load from bundle",TxFiles[z]);
+        return img;
     }
+    return TextureManager_load(path);
+}
+// texture upload, must run on the thread owning the renderer
+void TextureManager_upload(TextureManager *tm,SDL_Surface *img[TxTotal]) {
+    TextureManager_pack(tm,img);
+    for(int z=0;z<TxTotal;++z) SDL_FreeSurface(img[z]); // ~4
 }
 void TextureManager_destroy(TextureManager *tm) {
+    SDL_DestroyTexture(tm->atlas); // ~3
     IMG_Quit(); // ~2
     SDL_DestroyRenderer(tm->ren); // ~1
 }
@@ -164,202 +275,386 @@ Tex *TextureManager_get(TextureManager *tm,ETx idx) {
 }
 void TextureManager_begin_draw(TextureManager *tm) {
     SDL_RenderClear(tm->ren);
+    tm->batch.calls = 0;
 }
-/*void display() {
-  draw(TxBG);
-  draw(TxBIRD);
-}*/
 void TextureManager_end_draw(TextureManager *tm) {
+    SpriteBatch_flush(&tm->batch);
     SDL_RenderPresent(tm->ren);
 }
 
+// Layer struct
+// a static part of a screen drawn once into a target texture, then put on
+// screen as one quad until invalidated
+// SDL's blending into a target cleared to 0 leaves premultiplied alpha, so
+// the layer is composited with ONE, ONE_MINUS_SRC_ALPHA; renderers without
+// target textures or custom blend modes (software) draw it every frame
+typedef void (*LayerFn)(void *ctx);
+struct Layer {
+    SDL_Texture *tex;
+    bool valid, direct;
+};
+void Layer_init(Layer *l) {
+    l->tex = 0;
+    l->valid = l->direct = false;
+}
+void Layer_open(Layer *l,TextureManager *tm) {
+    SDL_BlendMode pre = SDL_ComposeCustomBlendMode(SDL_BLENDFACTOR_ONE,SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,SDL_BLENDOPERATION_ADD,
+                                                   SDL_BLENDFACTOR_ONE,SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,SDL_BLENDOPERATION_ADD);
+    if(SDL_RenderTargetSupported(tm->ren))
+        l->tex = SDL_CreateTexture(tm->ren,SDL_PIXELFORMAT_ARGB8888,SDL_TEXTUREACCESS_TARGET,W,H); // 1
+    if(l->tex && !SDL_SetTextureBlendMode(l->tex,pre)) return;
+    if(l->tex) SDL_DestroyTexture(l->tex);
+    l->tex = 0;
+    l->direct = true;
+}
+// contents are lost on render target or device resets
+void Layer_invalidate(Layer *l) {
+    l->valid = false;
+}
+void Layer_draw(Layer *l,TextureManager *tm,LayerFn fn,void *ctx) {
+    if(!l->tex && !l->direct) Layer_open(l,tm);
+    if(l->direct) {
+        fn(ctx);
+        return;
+    }
+    if(!l->valid) {
+        Uint8 r, g, b, a;
+        SpriteBatch_flush(&tm->batch);
+        SDL_SetRenderTarget(tm->ren,l->tex);
+        SDL_GetRenderDrawColor(tm->ren,&r,&g,&b,&a);
+        SDL_SetRenderDrawColor(tm->ren,0,0,0,0);
+        SDL_RenderClear(tm->ren);
+        SDL_SetRenderDrawColor(tm->ren,r,g,b,a);
+        fn(ctx);
+        SpriteBatch_flush(&tm->batch);
+        SDL_SetRenderTarget(tm->ren,0);
+        l->valid = true;
+    }
+    SDL_Rect all = {0,0,W,H};
+    SpriteBatch_quad(&tm->batch,l->tex,W,H,all,all,ClOpaque);
+}
+// before TextureManager_destroy, the texture belongs to its renderer
+void Layer_destroy(Layer *l) {
+    if(l->tex) SDL_DestroyTexture(l->tex); // ~1
+}
+
 
 // SoundManager struct
 enum EAu { AuClick, AuCrash, AuDie, AuHit, AuPoint, AuWing, AuStart, AuWall, AuTotal};
+const char AuFiles[AuTotal][24] = { // urutan harus sama dengan EAu
+                                    "click.wav",
+                                    "crash.wav",
+                                    "sfx_die.wav",
+                                    "sfx_hit.wav",
+                                    "sfx_point.wav",
+                                    "sfx_wing.wav",
+                                    "start.wav",
+                                    "wall.wav"
+                                  };
+// the tick only queues sound events, the audio thread starts them at the
+// beginning of its next mixing pass, so the game never takes the mixer lock
+// wing flaps share AuWingVoices reserved channels, a new flap cuts the
+// oldest instead of piling up voices
+// FLAPPY_MUTE (qmake CONFIG+=mute) builds without any SDL_mixer call
+enum EAuFormat { AuFreq = 44100, AuChannels = 2, AuWingVoices = 2 };
+#ifdef FLAPPY_MUTE
+enum EAuLoad { AuLoad = 0 }; // sounds decoded by AssetLoader
+#else
+enum EAuLoad { AuLoad = AuTotal };
+#endif
 struct SoundManager {
     Mix_Chunk *au[AuTotal];
+    SoundQueue q;
+    int wing; // next wing channel, audio thread only
 };
-void SoundManager_init(SoundManager *sm,AbsPath *folder) {
+#ifndef FLAPPY_MUTE
+// audio thread, before the channels are mixed, so a sound queued now
+// starts in this buffer; the mixer lock is held here and is recursive
+// repeats of one sound within a pass play once
+void SDLCALL SoundManager_drain(void *udata,Uint8 *,int) {
+    SoundManager *sm = (SoundManager*) udata;
+    unsigned played = 0;
+    for(int ev;(ev = SoundQueue_pop(&sm->q))>=0;) {
+        if(played & 1u<<ev) continue;
+        played |= 1u<<ev;
+        if(ev==AuWing) Mix_PlayChannel(sm->wing++%AuWingVoices,sm->au[ev],0);
+        else Mix_PlayChannel(-1,sm->au[ev],0);
+    }
+}
+void SoundManager_init(SoundManager *sm) {
+    memset(sm->au,0,sizeof(sm->au));
+    SoundQueue_init(&sm->q);
+    sm->wing = 0;
     int flag = MIX_INIT_OGG|MIX_INIT_MP3;
     if( (Mix_Init(flag) & flag) != flag ) // 1
         error1("Failed to init OGG and MP3 support");
-    if(Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 1024) == -1)
+    if(Mix_OpenAudio(AuFreq, MIX_DEFAULT_FORMAT, AuChannels, 1024) == -1)
         error1("Failed to open audio");
-    static const char files[AuTotal][24] = { // urutan harus sama dengan EAu
-                                             "click.wav",
-                                             "crash.wav",
-                                             "sfx_die.wav",
-                                             "sfx_hit.wav",
-                                             "sfx_point.wav",
-                                             "sfx_wing.wav",
-                                             "start.wav",
-                                             "wall.wav"
-                                           };
-    AbsPath_setSuffix(folder,"/a/");
-    for(int z=0;z<AuTotal;++z) {
-        if(!AbsPath_cat(folder,files[z],"audio"))
-            error2("File does not exists",folder->path);
-        Mix_Chunk *mus = sm->au[z] = Mix_LoadWAV(folder->path); // 2
-        if(!mus) error2("Failed to load",folder->path);
-    }
+    Mix_ReserveChannels(AuWingVoices);
+}
+// bundled PCM in the device format, the device must be open already
+const BundleEntry *SoundManager_find(const Bundle *pak,int z) {
+    int freq, ch;
+    Uint16 fmt;
+    Mix_QuerySpec(&freq,&fmt,&ch);
+    const BundleEntry *e = Bundle_find(pak,"a",AuFiles[z]);
+    if(e && e->kind==BkPcm && e->w==(unsigned)freq && e->h==(unsigned)(fmt<<8|ch)) return e;
+    return 0;
+}
+// path is only read when the bundle lacks the sound, runs on any thread
+Mix_Chunk *SoundManager_decode(const Bundle *pak,int z,const char path[]) {
+    const BundleEntry *e = SoundManager_find(pak,z);
+    Mix_Chunk *mus = e ? Mix_QuickLoad_RAW((Uint8*)Bundle_data(pak,e),e->size) // 2, played from the mapping
+                       : Mix_LoadWAV(path); // 2
+    if(!mus) error2("Failed to load",e ? AuFiles[z] : path);
+    return mus;
+}
+// sounds are loaded, start draining the queue
+void SoundManager_start(SoundManager *sm) {
+    Mix_HookMusic(SoundManager_drain,sm); // 3
 }
 void SoundManager_destroy(SoundManager *sm) {
+    Mix_HookMusic(0,0); // ~3
     for(int z=0;z<AuTotal;++z) Mix_FreeChunk(sm->au[z]); // ~2
+    Mix_CloseAudio(); // a reopen in the same process must not reuse the old device
     Mix_Quit(); // ~1
 }
-void SoundManager_play(SoundManager *sm,EAu idx,int count=0) {
-    Mix_PlayChannel(-1,sm->au[idx],count);
+void SoundManager_play(SoundManager *sm,EAu idx) {
+    SoundQueue_push(&sm->q,idx);
 }
+#else
+void SoundManager_init(SoundManager *sm) { memset(sm->au,0,sizeof(sm->au)); }
+const BundleEntry *SoundManager_find(const Bundle *,int) { return 0; }
+Mix_Chunk *SoundManager_decode(const Bundle *,int,const char []) { return 0; }
+void SoundManager_start(SoundManager *) {}
+void SoundManager_destroy(SoundManager *) {}
+inline void SoundManager_play(SoundManager *,EAu) {}
+#endif
 
 // FontManager struct
+// every font is baked once into a glyph atlas (printable ASCII), strings
+// are queued as quads on the SpriteBatch: no allocation or upload per call
 enum EFt { FtArial, FtVerdana, FtSourceCodePro, FtTotal};
-const size_t MAX_CACHE = 4096;
+const char FtFiles[FtTotal][24] = { // urutan harus sama dengan EFt
+                                    "arial.ttf",
+                                    "verdana.ttf",
+                                    "source_code_pro.ttf",
+                                  };
+enum EFtAtlas { FtFirst = 32, FtLast = 126, FtGlyphs = FtLast-FtFirst+1, FtAtlasW = 256 };
+struct Glyph {
+    SDL_Rect src; // in the atlas, w==0 for blank glyphs
+    int advance;
+};
+struct FontAtlas {
+    SDL_Texture *tex;
+    int w, h;
+    Glyph g[FtGlyphs];
+};
 struct FontManager {
     TTF_Font *ft[FtTotal];
-    Tex* tx[MAX_CACHE];
-    size_t tx_count;
-    SDL_Renderer *ren;
+    FontAtlas at[FtTotal];
+    SpriteBatch *batch;
 };
-void FontManager_init(FontManager *fm,AbsPath *folder,SDL_Renderer *ren) {
-    fm->tx_count = 0;
-    fm->ren = ren;
+void FontAtlas_init(FontAtlas *at,TTF_Font *font,SDL_Renderer *ren) {
+    SDL_Surface *img[FtGlyphs];
+    const SDL_Color white = {255,255,255,255};
+    int x = 0, y = 0, row = 0;
+    for(int z=0;z<FtGlyphs;++z) { // shelf packing
+        char str[2] = {(char)(FtFirst+z),0};
+        int minx, maxx, miny, maxy;
+        TTF_GlyphMetrics(font,FtFirst+z,&minx,&maxx,&miny,&maxy,&at->g[z].advance);
+        img[z] = z ? TTF_RenderText_Blended(font,str,white) : 0; // ~1
+        if(z && !img[z]) error2("Failed to render glyph",str);
+        int w = img[z] ? img[z]->w : 0, h = img[z] ? img[z]->h : 0;
+        if(x+w>FtAtlasW) {
+            x = 0;
+            y += row;
+            row = 0;
+        }
+        SDL_Rect_set_xywh(&at->g[z].src,x,y,w,h);
+        x += w;
+        if(h>row) row = h;
+    }
+    at->w = FtAtlasW;
+    at->h = y+row;
+    SDL_Surface *atlas = SDL_CreateRGBSurfaceWithFormat(0,at->w,at->h,32,SDL_PIXELFORMAT_RGBA32); // 2
+    if(!atlas) error1("Failed to create glyph atlas");
+    for(int z=0;z<FtGlyphs;++z) {
+        if(!img[z]) continue;
+        SDL_SetSurfaceBlendMode(img[z],SDL_BLENDMODE_NONE); // copy alpha as is
+        SDL_BlitSurface(img[z],0,atlas,&at->g[z].src);
+        SDL_FreeSurface(img[z]); // ~1
+    }
+    at->tex = SDL_CreateTextureFromSurface(ren,atlas); // 3
+    ++TextureUploads;
+    SDL_FreeSurface(atlas); // ~2
+    if(!at->tex) error1("Failed to create glyph atlas texture");
+    SDL_SetTextureBlendMode(at->tex,SDL_BLENDMODE_BLEND);
+}
+void FontManager_init(FontManager *fm,AbsPath *folder,const Bundle *pak,SpriteBatch *batch) {
+    fm->batch = batch;
     if( TTF_Init() ) // 1
         error1("Failed to init TTF support");
-    static const char files[FtTotal][24] = { // urutan harus sama dengan EFt
-                                             "arial.ttf",
-                                             "verdana.ttf",
-                                             "source_code_pro.ttf",
-                                           };
     AbsPath_setSuffix(folder,"/f/");
     for(int z=0;z<FtTotal;++z) {
-        if(!AbsPath_cat(folder,files[z],"font"))
-            error2("File does not exists",folder->path);
-        TTF_Font *fnt = fm->ft[z] = TTF_OpenFont(folder->path,18); // 2
-        if(!fnt) error2("Failed to load",folder->path);
+        const BundleEntry *e = Bundle_find(pak,"f",FtFiles[z]);
+        TTF_Font *fnt;
+        if(e) fnt = fm->ft[z] = TTF_OpenFontRW(SDL_RWFromConstMem(Bundle_data(pak,e),e->size),1,18); // 2
+        else {
+            if(!AbsPath_cat(folder,FtFiles[z],"font"))
+                error2("File does not exists",folder->path);
+            fnt = fm->ft[z] = TTF_OpenFont(folder->path,18); // 2
+        }
+        if(!fnt) error2("Failed to load font",FtFiles[z]);
+        FontAtlas_init(&fm->at[z],fnt,batch->ren); // 3
     }
 }
 void FontManager_destroy(FontManager *fm) {
-    for(size_t z=0;z<fm->tx_count;++z) delete fm->tx[z]; // ~3
+    for(int z=0;z<FtTotal;++z) SDL_DestroyTexture(fm->at[z].tex); // ~3
     for(int z=0;z<FtTotal;++z) TTF_CloseFont(fm->ft[z]); // ~2
     TTF_Quit(); // ~1
 }
-int FontManager_draw(FontManager *fm,EFt idx,const char* str,const SDL_Color &fg,int x,int y) {
-    Tex *tex = new Tex();
-    Tex_load_at(tex,fm->ft[idx],str,fg,fm->ren,x,y);
-    if(fm->tx_count<MAX_CACHE) fm->tx[fm->tx_count++] = tex;
-    else exit(99);
-    return fm->tx_count-1;
+int FontManager_width(FontManager *fm,EFt idx,const char* str) {
+    int w = 0;
+    for(const unsigned char *c=(const unsigned char*)str;*c;++c)
+        if(*c>=FtFirst && *c<=FtLast) w += fm->at[idx].g[*c-FtFirst].advance;
+    return w;
+}
+void FontManager_draw(FontManager *fm,EFt idx,const char* str,const SDL_Color &fg,int x,int y) {
+    FontAtlas *at = &fm->at[idx];
+    SDL_Color cl = fg;
+    cl.a = 255; // the Cl* colors leave alpha 0
+    for(const unsigned char *c=(const unsigned char*)str;*c;++c) {
+        if(*c<FtFirst || *c>FtLast) continue;
+        const Glyph *g = &at->g[*c-FtFirst];
+        SDL_Rect d = {x,y,g->src.w,g->src.h};
+        SpriteBatch_quad(fm->batch,at->tex,at->w,at->h,g->src,d,cl);
+        x += g->advance;
+    }
+}
+
+// AssetLoader struct
+// images and sounds are decoded on worker threads while the main thread
+// creates the renderer and bakes the font atlases, only the texture
+// upload waits for them
+enum EAl { AlJobs = TxTotal+AuLoad };
+struct AssetLoader {
+    const Bundle *pak;
+    char path[AlJobs][BUFF_LEN]; // unused when the bundle has the asset
+    SDL_Surface *img[TxTotal];
+    Mix_Chunk *au[AuTotal];
+    double sec[AlJobs]; // decode time of each job
+    atomic<int> next;
+    vector<thread> th;
+};
+void AssetLoader_work(AssetLoader *al) {
+    const double freq = SDL_GetPerformanceFrequency();
+    for(int z;(z = al->next++)<AlJobs;) {
+        Uint64 t0 = SDL_GetPerformanceCounter();
+        if(z<TxTotal) al->img[z] = TextureManager_decode(al->pak,z,al->path[z]);
+        else al->au[z-TxTotal] = SoundManager_decode(al->pak,z-TxTotal,al->path[z]);
+        al->sec[z] = (SDL_GetPerformanceCounter()-t0)/freq;
+    }
+}
+// file checks and the "Loading" lines stay on the calling thread
+void AssetLoader_start(AssetLoader *al,AbsPath *folder,const Bundle *pak) {
+    al->pak = pak;
+    AbsPath_setSuffix(folder,"/i/");
+    for(int z=0;z<TxTotal;++z) {
+        al->path[z][0] = 0;
+        const BundleEntry *e = Bundle_find(pak,"i",TxFiles[z]);
+        if(e && e->kind==BkPixels) continue;
+        if(!AbsPath_cat(folder,TxFiles[z],"image"))
+            error2("File does not exists",folder->path);
+        strcpy(al->path[z],folder->path);
+    }
+    memset(al->au,0,sizeof(al->au));
+    AbsPath_setSuffix(folder,"/a/");
+    for(int z=0;z<AuLoad;++z) {
+        al->path[TxTotal+z][0] = 0;
+        if(SoundManager_find(pak,z)) continue;
+        if(!AbsPath_cat(folder,AuFiles[z],"audio"))
+            error2("File does not exists",folder->path);
+        strcpy(al->path[TxTotal+z],folder->path);
+    }
+    int n = thread::hardware_concurrency();
+    if(n<1) n = 1;
+    if(n>AlJobs) n = AlJobs;
+    al->next = 0;
+    for(int z=0;z<n;++z) al->th.push_back(thread(AssetLoader_work,al));
 }
-void FontManager_draw_from_cache(FontManager *fm,int cache) {
-    Tex_draw(fm->tx[cache]);
+void AssetLoader_finish(AssetLoader *al) {
+    for(size_t z=0;z<al->th.size();++z) al->th[z].join();
 }
 
 // enum game state
 enum EGs { GsMENU, GsPLAY, GsEND, GsEXIT, GsTOTAL };
 
 // Bird struct!
+// physics lives in SimWorld, Bird only draws it and plays the sounds
 struct Bird {
     bool is_hidden;
-    double vy, ay, g; // v=velocity, a=acceleration, g=gravity
     Tex *bird;
     SoundManager *sM;
-    int point; // +1 for every pipe passed
+    const SimVariant *var;
+    SimWorld *w;
+    const SimWorld *view; // interpolated between ticks, for drawing
 };
 
 void Bird_reset(Bird *b) {
-    b->point = 0;
     b->is_hidden = false;
-    b->vy = 0;
-    b->ay = 0;
-    b->g = 2;
-    Tex_set_xy(b->bird,100,150);
+    Tex_set_xy(b->bird,SimBirdX,b->w->y);
 }
-void Bird_init(Bird *b,TextureManager *tm,SoundManager *sm) {
+void Bird_init(Bird *b,TextureManager *tm,SoundManager *sm,const SimVariant *var,SimWorld *w,const SimWorld *view) {
     b->bird = TextureManager_get(tm,TxBird);
     b->sM = sm;
+    b->var = var;
+    b->w = w;
+    b->view = view;
     Bird_reset(b);
 }
 void Bird_jump(Bird *b) {
-    b->vy = -10;
+    b->var->jump(b->w);
     SoundManager_play(b->sM,AuWing);
 }
 void Bird_stabilize(Bird *b) {
-    if(b->bird->pos.y>150) Bird_jump(b);
+    if(b->w->y>SimBirdY) Bird_jump(b);
 }
 void Bird_tick(Bird *b) {
     if(b->is_hidden) return;
-    b->bird->pos.y += b->vy;
-    b->vy += b->g;
-    b->vy -= b->ay;
+    b->var->tick_bird(b->w);
 }
 void Bird_draw(Bird *b) {
     if(b->is_hidden) return;
+    Tex_set_xy(b->bird,SimBirdX,b->view->y);
     Tex_draw(b->bird);
 }
-int Bird_bottom(const Bird *b) { return b->bird->pos.y+b->bird->pos.h; }
-int Bird_left(const Bird *b) { return b->bird->pos.x; }
-const SDL_Rect* Bird_rect(const Bird *b) {
-    return &b->bird->pos;
-}
 void Bird_hide(Bird *b) { b->is_hidden = true; }
 void Bird_show(Bird *b) { b->is_hidden = false; }
 
 // Pipe struct
+// source and destination rects for one pipe, rebuilt from SimWorld on draw
 struct Pipe {
-    bool is_hidden;
-    int up, left;
-    int speed, space;
     Tex *top, *btm;
+    int space; // gap of the variant
     SDL_Rect st, dt, sb, db;
 };
-void Pipe_reset(Pipe *wa) {
-    wa->up = 40 + rand() % 240;
-    int h = wa->top->pos.h, w = wa->top->pos.w;
-    SDL_Rect_set_xywh(&wa->st,0,h-wa->up,w,wa->up);
-    SDL_Rect_set_xywh(&wa->dt,wa->left,0,w,wa->up);
-    h = wa->btm->pos.h;
-    w = wa->btm->pos.w;
-    int hh = H-wa->up-wa->space;
-    SDL_Rect_set_xywh(&wa->sb,0,0,w,hh);
-    SDL_Rect_set_xywh(&wa->db,wa->left,wa->up+wa->space,w,hh);
-}
-void Pipe_init(Pipe *wa,TextureManager *tm,int speed,int left=W) {
-    wa->left = left;
-    wa->speed = speed ;
-    wa->space = 80;
+void Pipe_init(Pipe *wa,TextureManager *tm,int space) {
+    wa->space = space;
     wa->top = TextureManager_get(tm,TxTPipe);
     wa->btm = TextureManager_get(tm,TxBPipe);
-    Pipe_reset(wa);
 }
-void Pipe_tick(Pipe *wa) {
-    int x = (wa->dt.x += -wa->speed);
-    if(x+wa->dt.w<0) {
-        wa->left = 400;
-        Pipe_reset(wa);
-    }
-    wa->db.x = x;
-}
-void Pipe_restart(Pipe *wa,int left) {
-    wa->left = left;
-    Pipe_reset(wa);
-}
-int Pipe_width(Pipe *wa) {
-    return wa->top->pos.w;
-}
-void Pipe_draw(Pipe *wa) {
+void Pipe_draw(Pipe *wa,int left,int up) {
+    int h = wa->top->pos.h, w = wa->top->pos.w;
+    SDL_Rect_set_xywh(&wa->st,0,h-up,w,up);
+    SDL_Rect_set_xywh(&wa->dt,left,0,w,up);
+    w = wa->btm->pos.w;
+    int hh = H-up-wa->space;
+    SDL_Rect_set_xywh(&wa->sb,0,0,w,hh);
+    SDL_Rect_set_xywh(&wa->db,left,up+wa->space,w,hh);
     Tex_draw(wa->top,&wa->st,&wa->dt);
     Tex_draw(wa->btm,&wa->sb,&wa->db);
 }
-bool Pipe_check_hit(Pipe *wa,Bird *b) {
-    return SDL_HasIntersection(Bird_rect(b),&wa->dt) ||
-            SDL_HasIntersection(Bird_rect(b),&wa->db);
-}
-bool Pipe_check_point(Pipe *wa,Bird *b) {
-    int x = wa->dt.x, l = Bird_left(b);
-    return (x>l && x<=l+wa->speed);
-}
-void Pipe_hide(Pipe *wa) { wa->is_hidden = true; }
-void Pipe_show(Pipe *wa) { wa->is_hidden = false; }
 
 // ScrollingBackground
 struct ScrollingBackground {
@@ -370,93 +665,58 @@ struct ScrollingBackground {
     Tex *ground;
     SDL_Rect gs1, gs2, gd1, gd2; // ground size, ground delta
     int baseline; // ground position
-    int speed; // progress speed
     SoundManager *sM;
-    Pipe p1, p2, p3; // 1st pipe, 2nd pipe, 3rd pipe
-    bool show_pipe;
+    const SimVariant *var;
+    SimWorld *w;
+    const SimWorld *view;
+    Pipe pipe;
 };
 void ScrollingBackground_reset(ScrollingBackground *sb) {
-    sb->show_pipe = false;
     sb->is_hidden = false;
-    SDL_Rect_set_xywh(&sb->bs1,0,0,W,H);
-    SDL_Rect_set_xywh(&sb->bs2,0,0,W,H);
-    SDL_Rect_set_xywh(&sb->bd1,0,0,W,H);
-    SDL_Rect_set_xywh(&sb->bd2,W,0,W,H);
-    int h = sb->baseline, z = H-h;
-    SDL_Rect_set_xywh(&sb->gs1,0,0,W,h);
-    SDL_Rect_set_xywh(&sb->gs2,0,0,W,h);
-    SDL_Rect_set_xywh(&sb->gd1,0,z,W,h);
-    SDL_Rect_set_xywh(&sb->gd2,W,z,W,h);
-}
-void ScrollingBackground_init(ScrollingBackground *sb,TextureManager *tm,SoundManager *sm) {
+}
+void ScrollingBackground_init(ScrollingBackground *sb,TextureManager *tm,SoundManager *sm,const SimVariant *var,SimWorld *w,const SimWorld *view) {
     sb->back = TextureManager_get(tm,TxBG);
     sb->ground = TextureManager_get(tm,TxGround);
     sb->baseline = sb->ground->pos.h;
-    sb->speed = 3;
     sb->sM = sm;
-    Pipe_init(&sb->p1,tm,sb->speed);
-    Pipe_init(&sb->p2,tm,sb->speed);
-    Pipe_init(&sb->p3,tm,sb->speed);
+    sb->var = var;
+    sb->w = w;
+    sb->view = view;
+    Pipe_init(&sb->pipe,tm,var->space);
     ScrollingBackground_reset(sb);
 }
 void ScrollingBackground_play(ScrollingBackground *sb) {
-    sb->show_pipe = true;
-    Pipe_restart(&sb->p1,W);
-    int w = W + Pipe_width(&sb->p2);
-    Pipe_restart(&sb->p2,W+w/3);
-    Pipe_restart(&sb->p3,W+w*2/3);
+    sb->var->play(sb->w);
 }
 void ScrollingBackground_tick(ScrollingBackground *sb) {
     if(sb->is_hidden) return;
-    sb->bs1.x += sb->speed;
-    sb->bs1.x %= W;
-    sb->bs1.w += (W-sb->speed);
-    sb->bs1.w %= W;
-    int w = sb->bs1.w;
-    sb->bs2.w = W-w;
-
-    sb->bd1.w = w;
-    sb->bd2.x = w;
-    sb->bd2.w = sb->bs2.w;
-
-    sb->gs1.x = sb->bs1.x;
-    sb->gs1.w = sb->bs1.w;
-    sb->gs2.w = sb->bs2.w;
-
-    sb->gd1.w = sb->bd1.w;
-    sb->gd2.x = sb->bd2.x;
-    sb->gd2.w = sb->bd2.w;
-
-    if(sb->show_pipe) {
-        Pipe_tick(&sb->p1);
-        Pipe_tick(&sb->p2);
-        Pipe_tick(&sb->p3);
-    }
+    sb->var->tick_scroll(sb->w);
 }
 void ScrollingBackground_draw(ScrollingBackground *sb) {
     if(sb->is_hidden) return;
+    const SimWorld *v = sb->view;
+    int x = v->scroll, w = (W-x)%W, h = sb->baseline, gy = H-h;
+    SDL_Rect_set_xywh(&sb->bs1,x,0,w,H);
+    SDL_Rect_set_xywh(&sb->bs2,0,0,W-w,H);
+    SDL_Rect_set_xywh(&sb->bd1,0,0,w,H);
+    SDL_Rect_set_xywh(&sb->bd2,w,0,W-w,H);
+    SDL_Rect_set_xywh(&sb->gs1,x,0,w,h);
+    SDL_Rect_set_xywh(&sb->gs2,0,0,W-w,h);
+    SDL_Rect_set_xywh(&sb->gd1,0,gy,w,h);
+    SDL_Rect_set_xywh(&sb->gd2,w,gy,W-w,h);
     Tex_draw(sb->back,&sb->bs1,&sb->bd1);
     Tex_draw(sb->back,&sb->bs2,&sb->bd2);
-    if(sb->show_pipe) {
-        Pipe_draw(&sb->p1);
-        Pipe_draw(&sb->p2);
-        Pipe_draw(&sb->p3);
+    if(v->show_pipe) {
+        for(int z=0;z<v->pipes;++z)
+            Pipe_draw(&sb->pipe,v->pipe_x[z],v->pipe_up[z]);
     }
     Tex_draw(sb->ground,&sb->gs1,&sb->gd1);
     Tex_draw(sb->ground,&sb->gs2,&sb->gd2);
 }
-bool ScrollingBackground_check_hit(ScrollingBackground *sb,Bird *b) {
-    if(Pipe_check_point(&sb->p1,b)
-            || Pipe_check_point(&sb->p2,b)
-            || Pipe_check_point(&sb->p3,b)) {
-        SoundManager_play(sb->sM,AuPoint);
-        b->point += 1;
-    }
-    if(b->bird->pos.y < 0
-            || Bird_bottom(b)>=H-sb->baseline
-            || Pipe_check_hit(&sb->p1,b)
-            || Pipe_check_hit(&sb->p2,b)
-            || Pipe_check_hit(&sb->p3,b)) {
+// sounds for the events of one SimWorld_step, true when the bird crashed
+bool ScrollingBackground_check_hit(ScrollingBackground *sb,int ev) {
+    if(ev & SimEvPoint) SoundManager_play(sb->sM,AuPoint);
+    if(ev & SimEvHit) {
         SoundManager_play(sb->sM,AuHit);
         return true;
     }
@@ -465,53 +725,207 @@ bool ScrollingBackground_check_hit(ScrollingBackground *sb,Bird *b) {
 void ScrollingBackground_hide(ScrollingBackground *sb) { sb->is_hidden = true; }
 void ScrollingBackground_show(ScrollingBackground *sb) { sb->is_hidden = false; }
 
+// FlappyEngine struct
+// every engine subsystem of one game in a single block: one allocation per
+// instance, torn down in reverse order of init by FlappyGame_destroy
+struct FlappyEngine {
+    SoundManager sM;
+    TextureManager tM;
+    FontManager fM;
+    ScrollingBackground bg;
+    Bird bird;
+    Layer menu, end; // static screens of GsMENU and GsEND
+};
+
+// InputQueue struct
+// flaps stamped with the performance counter of the key press, each one is
+// applied by the tick whose window contains its stamp instead of whichever
+// tick runs next, so the response does not depend on when frames poll
+enum EIn { InMaxFlaps = 16 };
+struct InputQueue {
+    Uint64 t[InMaxFlaps];
+    int head, n;
+};
+void InputQueue_clear(InputQueue *q) {
+    q->head = q->n = 0;
+}
+// a full queue drops the flap, the bird can't use more than one per tick
+void InputQueue_push(InputQueue *q,Uint64 t) {
+    if(q->n==InMaxFlaps) return;
+    q->t[(q->head+q->n++)%InMaxFlaps] = t;
+}
+// pops the oldest flap stamped at or before due, false when there is none
+bool InputQueue_pop(InputQueue *q,Uint64 due,Uint64 *t) {
+    if(!q->n || q->t[q->head]>due) return false;
+    *t = q->t[q->head];
+    q->head = (q->head+1)%InMaxFlaps;
+    --q->n;
+    return true;
+}
+
 // FlappyGame struct
 // tick = calculation
 // draw = rendering
 // input = check for user input
 struct FlappyGame {
-    // engine related:
+    // engine related, all inside eng:
+    FlappyEngine *eng;
     TextureManager *tM;
     SoundManager *sM;
     FontManager *fM;
-    enum EFr { FrFPS = 20, FrRate = 1000/FrFPS };
     // game related:
+    const SimVariant *var; // physics, pipes and tick rate
     EGs state;
+    SimWorld world, prev, view; // now, last tick, interpolated for drawing
     ScrollingBackground *bg;
     Bird *bird;
     SDL_Window *win;
+    SDL_Surface *screen; // offscreen target, 0 with a window
+    ObsPool obs; // offscreen observations, n is 0 for the raw screen
+    ObsFrame screen_obs;
     AbsPath path;
-    int end_score_text_cache;
+    Bundle pak; // empty when there is no flappy.pak
+    char end_score_text[32];
+    FILE *rec_file; // --record log, 0 when not recording
+    ReplayRec rec;
+    Profiler prof; // F3 toggles the overlay
+    const char *trace_path; // --trace output, 0 when not tracing
+    MetricsShard *met; // counters of the thread running the game
+    InputQueue in; // flaps of GsPLAY waiting for their tick
+    Uint64 tick_due; // counter at the end of the next tick's window, ~0 takes every flap
+    SimWorld shown; // view of the frame on screen
+    EGs shown_state;
+    bool redraw; // present the next frame even when nothing moved
+    bool always_draw; // --always-draw, never skip idle frames
 };
-void FlappyGame_init(FlappyGame *fg) {
+// SimWorld hardcodes the sprite sizes so it can run without textures
+void FlappyGame_check_sprites(FlappyGame *fg) {
+    SDL_Rect *b = Tex_pos(TextureManager_get(fg->tM,TxBird));
+    SDL_Rect *p = Tex_pos(TextureManager_get(fg->tM,TxTPipe));
+    SDL_Rect *g = Tex_pos(TextureManager_get(fg->tM,TxGround));
+    if(b->w!=SimBirdW || b->h!=SimBirdH || p->w!=SimPipeW || g->h!=SimGroundH) {
+        printf("Sprite size does not match simulation\n");
+        exit(3);
+    }
+}
+// startup timing breakdown, in ms since t0
+double FlappyGame_ms(Uint64 t0) {
+    return (SDL_GetPerformanceCounter()-t0)*1000.0/SDL_GetPerformanceFrequency();
+}
+void FlappyGame_load(FlappyGame *fg,Uint64 t0) {
+    double sdl = FlappyGame_ms(t0);
+    SoundManager_init(fg->sM); // 3
+    TextureManager_init(fg->tM); // 4a
+    double audio = FlappyGame_ms(t0);
+    AssetLoader al;
+    AssetLoader_start(&al,&fg->path,&fg->pak);
+    TextureManager_open(fg->tM,fg->win,fg->screen);
+    double ren = FlappyGame_ms(t0);
+    FontManager_init(fg->fM,&fg->path,&fg->pak,&fg->tM->batch); // 4b
+    double font = FlappyGame_ms(t0);
+    AssetLoader_finish(&al);
+    double wait = FlappyGame_ms(t0), cpu = 0;
+    for(int z=0;z<AlJobs;++z) cpu += al.sec[z]*1000;
+    memcpy(fg->sM->au,al.au,sizeof(al.au));
+    SoundManager_start(fg->sM);
+    TextureManager_upload(fg->tM,al.img);
+    double upload = FlappyGame_ms(t0);
+    printf("\nStartup: sdl %.1fms, audio %.1fms, renderer %.1fms, fonts %.1fms, "
+           "decode wait %.1fms (%.1fms on %d threads), upload %.1fms, total %.1fms\n",
+           sdl,audio-sdl,ren-audio,font-ren,wait-font,cpu,(int)al.th.size(),upload-wait,upload);
+}
+// assets, world and actors, once the window or offscreen surface exists
+void FlappyGame_start(FlappyGame *fg,unsigned seed,Uint64 t0) {
+    fg->eng = (FlappyEngine*) malloc(sizeof(FlappyEngine));
+    fg->sM = &fg->eng->sM;
+    fg->tM = &fg->eng->tM;
+    fg->fM = &fg->eng->fM;
+    fg->bg = &fg->eng->bg;
+    fg->bird = &fg->eng->bird;
+    Layer_init(&fg->eng->menu);
+    Layer_init(&fg->eng->end);
+    fg->redraw = true;
+    fg->always_draw = false;
+    fg->met = Metrics_local();
+    InputQueue_clear(&fg->in);
+    fg->tick_due = ~(Uint64)0; // without the timed loop every queued flap is due
+    AbsPath_init(&fg->path);
+    AbsPath_setSuffix(&fg->path,"/");
+    if(AbsPath_cat(&fg->path,"flappy.pak","bundle") && Bundle_open(&fg->pak,fg->path.path))
+        printf(" (%u entries)\n",fg->pak.count);
+    else
+        Bundle_close(&fg->pak);
+    FlappyGame_load(fg,t0);
+    FlappyGame_check_sprites(fg);
+    fg->var->init(&fg->world,seed);
+    fg->prev = fg->view = fg->world;
+    ScrollingBackground_init(fg->bg,fg->tM,fg->sM,fg->var,&fg->world,&fg->view); // 5
+    Bird_init(fg->bird,fg->tM,fg->sM,fg->var,&fg->world,&fg->view); // 6
+    Tex_set_xy(TextureManager_get(fg->tM,TxReady),160,120);
+    Tex_set_xy(TextureManager_get(fg->tM,TxInstruct),120,200);
+    Tex_set_xy(TextureManager_get(fg->tM,TxEnd),120,100);
+}
+void FlappyGame_init(FlappyGame *fg,const SimVariant *var,unsigned seed,const char *record,const char *trace) {
+    Uint64 t0 = SDL_GetPerformanceCounter();
+    fg->var = var;
     fg->state = GsMENU;
+    fg->trace_path = trace;
+    Profiler_init(&fg->prof,trace!=0);
+    fg->rec_file = 0;
+    if(record && !(fg->rec_file = fopen(record,"ab"))) {
+        printf("Failed to open record '%s'\n",record);
+        exit(5);
+    }
     puts( "Initializing SDL.." );
     if(SDL_Init(SDL_INIT_EVERYTHING)) error1("SDL_Init Error"); // 1
     fg->win = SDL_CreateWindow("Flappy Bird!", 100, 100, W, H, SDL_WINDOW_SHOWN); // 2
     if (!fg->win) error1("SDL_CreateWindow Error");
-    fg->sM = (SoundManager*) malloc(sizeof(SoundManager));
-    AbsPath_init(&fg->path);
-    SoundManager_init(fg->sM,&fg->path); // 3
-    fg->tM = (TextureManager*) malloc(sizeof(TextureManager));
-    TextureManager_init(fg->tM,&fg->path,fg->win); // 4a
-    fg->fM = (FontManager*) malloc(sizeof(FontManager));
-    FontManager_init(fg->fM,&fg->path,fg->tM->ren); // 4b
-    fg->bg = (ScrollingBackground*) malloc(sizeof(ScrollingBackground));
-    ScrollingBackground_init(fg->bg,fg->tM,fg->sM); // 5
-    fg->bird = (Bird*)malloc(sizeof(Bird));
-    Bird_init(fg->bird,fg->tM,fg->sM); // 6
-    Tex_set_xy(TextureManager_get(fg->tM,TxReady),160,120);
-    Tex_set_xy(TextureManager_get(fg->tM,TxInstruct),120,200);
-    Tex_set_xy(TextureManager_get(fg->tM,TxEnd),120,100);
+    fg->screen = 0;
+    FlappyGame_start(fg,seed,t0);
+}
+// no window and no sound card: frames are drawn into fg->screen by SDL's
+// software renderer, sounds go to the dummy audio driver
+// spec 0 hands out the screen itself, else each observation is converted
+// into the next of frames pooled buffers
+void FlappyGame_init_offscreen(FlappyGame *fg,const SimVariant *var,unsigned seed,const ObsSpec *spec,int frames) {
+    Uint64 t0 = SDL_GetPerformanceCounter();
+    fg->var = var;
+    fg->state = GsMENU;
+    fg->trace_path = 0;
+    Profiler_init(&fg->prof,false);
+    fg->rec_file = 0;
+    SDL_setenv("SDL_AUDIODRIVER","dummy",1);
+    if(SDL_Init(AuLoad>0 ? SDL_INIT_AUDIO : 0)) error1("SDL_Init Error"); // 1
+    fg->win = 0;
+    fg->screen = SDL_CreateRGBSurfaceWithFormat(0,W,H,32,SDL_PIXELFORMAT_RGBA32); // 2
+    if(!fg->screen) error1("Failed to create offscreen surface");
+    ObsFrame so = {(unsigned char*)fg->screen->pixels,W,H,fg->screen->pitch,4,0};
+    fg->screen_obs = so;
+    memset(&fg->obs,0,sizeof(ObsPool));
+    if(spec) ObsPool_init(&fg->obs,spec,frames); // 3
+    FlappyGame_start(fg,seed,t0);
 }
 void FlappyGame_destroy(FlappyGame *fg) {
-    free(fg->bird); // ~6
-    free(fg->fM); // ~4b
-    delete fg->bg; // ~5
-    free(fg->tM); // ~4a
-    delete fg->sM; // ~3
-    SDL_DestroyWindow(fg->win); // ~2
+    // ~6 ~5: bird and bg only point into the managers
+    Layer_destroy(&fg->eng->end);
+    Layer_destroy(&fg->eng->menu);
+    FontManager_destroy(fg->fM); // ~4b
+    TextureManager_destroy(fg->tM); // ~4a
+    SoundManager_destroy(fg->sM); // ~3, the drain hook goes before sM
+    free(fg->eng);
+    if(fg->rec_file) fclose(fg->rec_file);
+    if(fg->prof.frames) Profiler_report(&fg->prof);
+    if(fg->trace_path) {
+        if(Profiler_write_trace(&fg->prof,fg->trace_path)) printf("Trace written to %s\n",fg->trace_path);
+        else printf("Failed to write trace '%s'\n",fg->trace_path);
+    }
+    if(fg->win) SDL_DestroyWindow(fg->win); // ~2
+    else {
+        ObsPool_destroy(&fg->obs); // ~3
+        SDL_FreeSurface(fg->screen); // ~2
+    }
     SDL_Quit(); // ~1
+    Bundle_close(&fg->pak); // sounds play from the mapping until audio is closed
     puts( "Cleaning SDL.." );
 }
 void FlappyGame_input_menu(FlappyGame *fg,SDL_Event& e) {
@@ -523,7 +937,11 @@ void FlappyGame_input_menu(FlappyGame *fg,SDL_Event& e) {
         case SDL_SCANCODE_KP_ENTER:
         case SDL_SCANCODE_SPACE:
             fg->state = GsPLAY;
+            printf("Seed: %u\n",fg->world.seed);
             ScrollingBackground_play(fg->bg);
+            fg->prev = fg->world; // pipes appear, nothing to interpolate from
+            InputQueue_clear(&fg->in);
+            ReplayRec_begin(&fg->rec,&fg->world);
             SoundManager_play(fg->sM,AuStart);
             break;
            case SDL_SCANCODE_ESCAPE:
@@ -533,6 +951,16 @@ void FlappyGame_input_menu(FlappyGame *fg,SDL_Event& e) {
         break;
     }
 }
+// performance counter at an event's SDL_GetTicks timestamp, polling can be
+// a whole frame later than the press; 0 timestamps of pushed events and
+// anything older than a second are stamped now
+Uint64 FlappyGame_event_time(Uint32 timestamp) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    Uint32 ago = SDL_GetTicks()-timestamp;
+    if(!timestamp || ago>1000) return now;
+    Uint64 back = (Uint64)ago*SDL_GetPerformanceFrequency()/1000;
+    return back<now ? now-back : 0;
+}
 void FlappyGame_input_play(FlappyGame *fg,SDL_Event& e) {
     switch(e.type) {
     case SDL_KEYDOWN: // SDL_KEYUP
@@ -542,7 +970,7 @@ void FlappyGame_input_play(FlappyGame *fg,SDL_Event& e) {
         case SDL_SCANCODE_RETURN2:
         case SDL_SCANCODE_KP_ENTER:
         case SDL_SCANCODE_UP:
-            Bird_jump(fg->bird);
+            InputQueue_push(&fg->in,FlappyGame_event_time(e.key.timestamp));
         default: break;
         }
         // e.key.keysym.scancode; // http://wiki.libsdl.org/SDL_Scancode
@@ -555,7 +983,7 @@ void FlappyGame_input_play(FlappyGame *fg,SDL_Event& e) {
     case SDL_MOUSEBUTTONDOWN: // SDL_MOUSEBUTTONUP
         switch(e.button.button) {
         case SDL_BUTTON_LEFT:
-            Bird_jump(fg->bird);
+            InputQueue_push(&fg->in,FlappyGame_event_time(e.button.timestamp));
             break;
         }
         // SDL_BUTTON_MIDDLE SDL_BUTTON_RIGHT
@@ -566,6 +994,8 @@ void FlappyGame_input_end(FlappyGame *fg,SDL_Event& e) {
     case SDL_KEYDOWN:
         switch(e.key.keysym.scancode) {
         case SDL_SCANCODE_ESCAPE:
+            fg->var->init(&fg->world,fg->world.rng); // next episode, new seed
+            fg->prev = fg->world;
             Bird_reset(fg->bird);
             ScrollingBackground_reset(fg->bg);
             fg->state = GsMENU;
@@ -574,6 +1004,22 @@ void FlappyGame_input_end(FlappyGame *fg,SDL_Event& e) {
         break;
     }
 }
+void FlappyGame_input(FlappyGame *fg,SDL_Event& e) {
+    switch(fg->state) {
+    case GsMENU: FlappyGame_input_menu(fg,e); break;
+    case GsPLAY: FlappyGame_input_play(fg,e); break;
+    case GsEND: FlappyGame_input_end(fg,e); break;
+    default: return;
+    }
+}
+// same as pressing a key in the window, for offscreen play
+void FlappyGame_key(FlappyGame *fg,SDL_Scancode sc) {
+    SDL_Event e;
+    memset(&e,0,sizeof(e));
+    e.type = SDL_KEYDOWN;
+    e.key.keysym.scancode = sc;
+    FlappyGame_input(fg,e);
+}
 void FlappyGame_check_input(FlappyGame *fg) {
     static SDL_Event e;
     while(SDL_PollEvent(&e)) {
@@ -581,13 +1027,24 @@ void FlappyGame_check_input(FlappyGame *fg) {
         case SDL_QUIT:
             fg->state = GsEXIT;
             return;
-        default:
-            switch(fg->state) {
-            case GsMENU: FlappyGame_input_menu(fg,e); break;
-            case GsPLAY: FlappyGame_input_play(fg,e); break;
-            case GsEND: FlappyGame_input_end(fg,e); break;
-            default: return;
+        case SDL_RENDER_TARGETS_RESET:
+        case SDL_RENDER_DEVICE_RESET:
+            Layer_invalidate(&fg->eng->menu);
+            Layer_invalidate(&fg->eng->end);
+            fg->redraw = true;
+            break;
+        case SDL_WINDOWEVENT: // exposed, resized, moved between displays
+            fg->redraw = true;
+            break;
+        case SDL_KEYDOWN:
+            if(e.key.keysym.scancode==SDL_SCANCODE_F3) {
+                fg->prof.overlay = !fg->prof.overlay;
+                fg->redraw = true;
+                break;
             }
+            // fallthrough
+        default:
+            FlappyGame_input(fg,e);
         }
     }
 }
@@ -596,13 +1053,31 @@ void FlappyGame_tick_menu(FlappyGame *fg) {
     Bird_tick(fg->bird);
     Bird_stabilize(fg->bird);
 }
+// flaps pressed before the end of this tick's window, several are one jump
+// latency is from the press to the tick applying it
+void FlappyGame_tick_flaps(FlappyGame *fg) {
+    Uint64 t, now = SDL_GetPerformanceCounter();
+    double ms = 1000.0/SDL_GetPerformanceFrequency();
+    bool flap = false;
+    while(InputQueue_pop(&fg->in,fg->tick_due,&t)) {
+        Profiler_input(&fg->prof,(now-t)*ms);
+        flap = true;
+    }
+    if(!flap) return;
+    ReplayRec_flap(&fg->rec,&fg->world);
+    Bird_jump(fg->bird);
+}
 void FlappyGame_tick_play(FlappyGame *fg) {
-    ScrollingBackground_tick(fg->bg);
-    Bird_tick(fg->bird);
-    if(ScrollingBackground_check_hit(fg->bg,fg->bird)) {
-        char end_score_text[256];
-        sprintf(end_score_text,"Your score: %d",fg->bird->point);
-        fg->end_score_text_cache = FontManager_draw(fg->fM,FtVerdana,end_score_text,ClDarkBlue,80,240);
+    FlappyGame_tick_flaps(fg);
+    int ev = fg->var->step(&fg->world,false); // flaps already applied above
+    Metrics_ticks(fg->met,1);
+    if(ScrollingBackground_check_hit(fg->bg,ev)) {
+        Metrics_episode(fg->met,fg->world.point,fg->world.y);
+        ReplayRec_end(&fg->rec,&fg->world);
+        if(fg->rec_file && !ReplayRec_write(&fg->rec,fg->rec_file)) puts("Failed to write record");
+        sprintf(fg->end_score_text,"Your score: %d",fg->world.point);
+        Layer_invalidate(&fg->eng->end);
+        InputQueue_clear(&fg->in);
         fg->state = GsEND;
     }
 }
@@ -616,22 +1091,44 @@ void FlappyGame_tick(FlappyGame *fg) {
     default: break;
     }
 }
-void FlappyGame_draw_menu(FlappyGame *fg) {
-    static int press = FontManager_draw(fg->fM,FtArial,"Press enter to start",ClBlack,100,300);
-    static int info = FontManager_draw(fg->fM,FtArial,"Press space/enter/click to flap",ClBlack,100,320);
+void FlappyGame_draw_menu_layer(void *ctx) {
+    FlappyGame *fg = (FlappyGame*) ctx;
     TextureManager_draw(fg->tM,TxReady);
     TextureManager_draw(fg->tM,TxInstruct);
-    FontManager_draw_from_cache(fg->fM,press);
-    FontManager_draw_from_cache(fg->fM,info);
+    FontManager_draw(fg->fM,FtArial,"Press enter to start",ClBlack,100,300);
+    FontManager_draw(fg->fM,FtArial,"Press space/enter/click to flap",ClBlack,100,320);
+}
+void FlappyGame_draw_menu(FlappyGame *fg) {
+    Layer_draw(&fg->eng->menu,fg->tM,FlappyGame_draw_menu_layer,fg);
 }
 void FlappyGame_draw_play(FlappyGame *fg) {
-
+    char score[16];
+    sprintf(score,"%d",fg->world.point);
+    FontManager_draw(fg->fM,FtSourceCodePro,score,ClWhite,(W-FontManager_width(fg->fM,FtSourceCodePro,score))/2,20);
+}
+// invalidated with each new end_score_text
+void FlappyGame_draw_end_layer(void *ctx) {
+    FlappyGame *fg = (FlappyGame*) ctx;
+    FontManager_draw(fg->fM,FtVerdana,"Press escape to return to menu",ClDarkBlue,80,200);
+    TextureManager_draw(fg->tM,TxEnd);
+    FontManager_draw(fg->fM,FtVerdana,fg->end_score_text,ClDarkBlue,80,240);
 }
 void FlappyGame_draw_end(FlappyGame *fg) {
-    static int press = FontManager_draw(fg->fM,FtVerdana,"Press escape to return to menu",ClDarkBlue,80,200);
-    FontManager_draw_from_cache(fg->fM,press);
-    TextureManager_draw(fg->tM,TxEnd);
-    FontManager_draw_from_cache(fg->fM,fg->end_score_text_cache);
+    Layer_draw(&fg->eng->end,fg->tM,FlappyGame_draw_end_layer,fg);
+}
+// frame times of the last ProfHistory frames, zones of the last frame
+void FlappyGame_draw_prof(FlappyGame *fg) {
+    const Profiler *p = &fg->prof;
+    char line[64];
+    sprintf(line,"p50 %.2fms p99 %.2fms",Profiler_percentile(p,50),Profiler_percentile(p,99));
+    FontManager_draw(fg->fM,FtSourceCodePro,line,ClBlack,4,4);
+    sprintf(line,"in %.2f tk %.2f dr %.2f pr %.2f",p->last_ms[ProfInput],p->last_ms[ProfTick],
+            p->last_ms[ProfDraw],p->last_ms[ProfPresent]);
+    FontManager_draw(fg->fM,FtSourceCodePro,line,ClBlack,4,24);
+    sprintf(line,"calls %d uploads %d",p->draw_calls,p->uploads);
+    FontManager_draw(fg->fM,FtSourceCodePro,line,ClBlack,4,44);
+    sprintf(line,"flap p50 %.2fms p99 %.2fms",Profiler_input_percentile(p,50),Profiler_input_percentile(p,99));
+    FontManager_draw(fg->fM,FtSourceCodePro,line,ClBlack,4,64);
 }
 void FlappyGame_draw(FlappyGame *fg) {
     ScrollingBackground_draw(fg->bg);
@@ -643,24 +1140,485 @@ void FlappyGame_draw(FlappyGame *fg) {
     default: break;
     }
 }
+// false when the next frame would look like the one on screen
+bool FlappyGame_changed(FlappyGame *fg) {
+    const SimWorld *a = &fg->shown, *b = &fg->view;
+    if(fg->always_draw || fg->redraw || fg->prof.overlay || fg->state!=fg->shown_state) return true;
+    if(a->y!=b->y || a->scroll!=b->scroll || a->point!=fg->world.point
+            || a->show_pipe!=b->show_pipe || a->pipes!=b->pipes) return true;
+    for(int z=0;z<b->pipes;++z)
+        if(a->pipe_x[z]!=b->pipe_x[z] || a->pipe_up[z]!=b->pipe_up[z]) return true;
+    return false;
+}
+void FlappyGame_shown(FlappyGame *fg) {
+    fg->shown = fg->view;
+    fg->shown.point = fg->world.point;
+    fg->shown_state = fg->state;
+    fg->redraw = false;
+}
+// fixed timestep: ticks run at the variant's fps from an accumulator,
+// frames are drawn as fast as vsync allows, interpolated between the last
+// two ticks
+// a frame identical to the one on screen is neither drawn nor presented,
+// the loop sleeps in SDL_WaitEventTimeout until the next tick or event
 int FlappyGame_play(FlappyGame *fg) {
-    unsigned fr;
+    const Uint64 freq = SDL_GetPerformanceFrequency(), step = freq/fg->var->fps;
+    Uint64 acc = 0, last = SDL_GetPerformanceCounter();
+    Profiler *p = &fg->prof;
+    int uploads = TextureUploads;
+    bool drawn = true;
     while(true) {
-        fr = SDL_GetTicks();
-        FlappyGame_check_input(fg);
+        Uint64 now = SDL_GetPerformanceCounter();
+        acc += now-last;
+        last = now;
+        if(acc>step*4) acc = step*4; // after a stall, don't try to catch up forever
+        if(drawn) {
+            Profiler_frame(p,fg->tM->batch.calls,TextureUploads-uploads);
+            Metrics_frame(fg->met,p->frame_ms[(p->frames-1)%ProfHistory]);
+            uploads = TextureUploads;
+        } else Profiler_idle(p);
+        {
+            ProfScope s(p,ProfInput);
+            FlappyGame_check_input(fg);
+        }
         if(fg->state==GsEXIT) return 0;
-        FlappyGame_tick(fg);
+        for(;acc>=step;acc-=step) {
+            ProfScope s(p,ProfTick);
+            // this tick stands for [now-acc,now-acc+step), the last one of the
+            // frame also takes the flaps polled after its window, they can't
+            // wait for a tick that runs a frame later
+            fg->tick_due = acc-step>=step ? now-acc+step : ~(Uint64)0;
+            fg->prev = fg->world;
+            FlappyGame_tick(fg);
+        }
+        fg->var->lerp(&fg->prev,&fg->world,(double)acc/step,&fg->view);
+        if(!(drawn = FlappyGame_changed(fg))) {
+            SDL_WaitEventTimeout(0,(int)((step-acc)*1000/freq)+1);
+            continue;
+        }
+        {
+            ProfScope s(p,ProfDraw);
+            TextureManager_begin_draw(fg->tM);
+            FlappyGame_draw(fg);
+            if(p->overlay) FlappyGame_draw_prof(fg);
+        }
+        {
+            ProfScope s(p,ProfPresent);
+            TextureManager_end_draw(fg->tM);
+        }
+        FlappyGame_shown(fg);
+        if(SDL_GetPerformanceCounter()-now<freq/1000) SDL_Delay(1); // no vsync
+    }
+}
+
+// --pack: decode every asset once into flappy.pak, loaded by mmap at startup
+// images become RGBA32 pixels, sounds PCM in the mixer format, fonts as is
+int FlappyGame_pack(const char *out) {
+    AbsPath path;
+    BundleWriter bw;
+    AbsPath_init(&path);
+    AbsPath_setSuffix(&path,"/i/");
+    for(int z=0;z<TxTotal;++z) {
+        if(!AbsPath_cat(&path,TxFiles[z],"image"))
+            error2("File does not exists",path.path);
+        puts("");
+        SDL_Surface *img = TextureManager_load(path.path);
+        SDL_Surface *rgba = SDL_ConvertSurfaceFormat(img,SDL_PIXELFORMAT_RGBA32,0);
+        SDL_FreeSurface(img);
+        if(!rgba) error2("Failed to convert",path.path);
+        vector<unsigned char> px(rgba->w*rgba->h*4);
+        for(int y=0;y<rgba->h;++y)
+            memcpy(&px[y*rgba->w*4],(unsigned char*)rgba->pixels+y*rgba->pitch,rgba->w*4);
+        BundleWriter_add(&bw,"i",TxFiles[z],BkPixels,rgba->w,rgba->h,&px[0],px.size());
+        SDL_FreeSurface(rgba);
+    }
+    AbsPath_setSuffix(&path,"/a/");
+    for(int z=0;z<AuTotal;++z) {
+        if(!AbsPath_cat(&path,AuFiles[z],"audio"))
+            error2("File does not exists",path.path);
+        puts("");
+        SDL_AudioSpec spec;
+        Uint8 *buf;
+        Uint32 len;
+        if(!SDL_LoadWAV(path.path,&spec,&buf,&len)) error2("Failed to load",path.path);
+        SDL_AudioCVT cvt;
+        SDL_BuildAudioCVT(&cvt,spec.format,spec.channels,spec.freq,MIX_DEFAULT_FORMAT,AuChannels,AuFreq);
+        vector<Uint8> pcm(len*(cvt.len_mult>0 ? cvt.len_mult : 1));
+        memcpy(&pcm[0],buf,len);
+        SDL_FreeWAV(buf);
+        cvt.buf = &pcm[0];
+        cvt.len = len;
+        if(cvt.needed && SDL_ConvertAudio(&cvt)) error2("Failed to convert",path.path);
+        BundleWriter_add(&bw,"a",AuFiles[z],BkPcm,AuFreq,MIX_DEFAULT_FORMAT<<8|AuChannels,
+                         &pcm[0],cvt.needed ? cvt.len_cvt : len);
+    }
+    AbsPath_setSuffix(&path,"/f/");
+    for(int z=0;z<FtTotal;++z) {
+        if(!AbsPath_cat(&path,FtFiles[z],"font"))
+            error2("File does not exists",path.path);
+        puts("");
+        FILE *f = fopen(path.path,"rb");
+        if(!f) error2("Failed to load",path.path);
+        vector<unsigned char> data;
+        unsigned char tmp[4096];
+        for(size_t n;(n = fread(tmp,1,sizeof(tmp),f))>0;) data.insert(data.end(),tmp,tmp+n);
+        fclose(f);
+        BundleWriter_add(&bw,"f",FtFiles[z],BkRaw,0,0,&data[0],data.size());
+    }
+    if(!BundleWriter_save(&bw,out)) error2("Failed to write",out);
+    printf("Packed %d assets into %s\n",(int)bw.index.size(),out);
+    return 0;
+}
+
+// the frame drawn last, zero copy: the screen itself (valid until the next
+// draw) or a pool frame (valid for the next obs.n-1 observations)
+const ObsFrame *FlappyGame_observe(FlappyGame *fg) {
+    fg->screen_obs.tick = fg->world.tick;
+    if(!fg->obs.n) return &fg->screen_obs;
+    ObsFrame *f = ObsPool_next(&fg->obs);
+    Obs_convert(fg->screen_obs.px,W,H,fg->screen_obs.pitch,f);
+    f->tick = fg->world.tick;
+    return f;
+}
+// sprites for Raster_init: straight from flappy.pak, else decoded again
+// since the atlas only lives on the renderer
+void FlappyGame_raster_init(FlappyGame *fg,Raster *r,const ObsSpec *spec) {
+    RasterImage img[RsTotal];
+    SDL_Surface *rgba[RsTotal] = {0};
+    if(!Raster_bundle_images(&fg->pak,img)) {
+        AbsPath_setSuffix(&fg->path,"/i/");
+        for(int z=0;z<RsTotal;++z) {
+            if(!AbsPath_cat(&fg->path,RsFiles[z],"image"))
+                error2("File does not exists",fg->path.path);
+            puts("");
+            SDL_Surface *s = TextureManager_load(fg->path.path);
+            rgba[z] = SDL_ConvertSurfaceFormat(s,SDL_PIXELFORMAT_RGBA32,0);
+            SDL_FreeSurface(s);
+            if(!rgba[z]) error2("Failed to convert",fg->path.path);
+            RasterImage i = {(const unsigned char*)rgba[z]->pixels,rgba[z]->w,rgba[z]->h,rgba[z]->pitch};
+            img[z] = i;
+        }
+    }
+    bool ok = Raster_init(r,spec,img);
+    for(int z=0;z<RsTotal;++z) SDL_FreeSurface(rgba[z]);
+    if(!ok) {
+        printf("Sprite size does not match simulation\n");
+        exit(3);
+    }
+}
+// --offscreen: the autopilot plays without a window, one frame per tick,
+// observations are optionally written raw (rows without padding) to dump,
+// with stack>1 as the last stack frames of the episode
+// raster draws observations from the world state only, skipping SDL
+int FlappyGame_offscreen(const SimVariant *var,int frames,const ObsSpec *spec,int stack,bool raster,const char *dump) {
+    FILE *f = 0;
+    if(dump && !(f = fopen(dump,"wb"))) {
+        printf("Failed to open '%s'\n",dump);
+        return 1;
+    }
+    FlappyGame fg;
+    ObsSpec full = {W,H,false};
+    if(raster && !spec) spec = &full;
+    FlappyGame_init_offscreen(&fg,var,1,spec,4);
+    puts("");
+    Raster r;
+    if(raster) {
+        FlappyGame_raster_init(&fg,&r,spec);
+        r.space = var->space;
+    }
+    ObsStack st;
+    if(stack>1) ObsStack_init(&st,spec ? spec : &full,stack);
+    const ObsFrame *o = 0;
+    Uint64 t0 = SDL_GetPerformanceCounter();
+    for(int z=0;z<frames;++z) {
+        if(fg.state==GsEND) {
+            FlappyGame_key(&fg,SDL_SCANCODE_ESCAPE);
+            if(stack>1) ObsStack_clear(&st);
+        } else if(fg.state==GsMENU || var->autopilot(&fg.world)) FlappyGame_key(&fg,SDL_SCANCODE_SPACE);
+        FlappyGame_tick(&fg);
+        fg.prev = fg.view = fg.world;
+        if(raster) {
+            ObsFrame sf;
+            if(stack>1) sf = ObsStack_next(&st);
+            ObsFrame *of = stack>1 ? &sf : ObsPool_next(&fg.obs);
+            Raster_draw(&r,&fg.world,of);
+            of->tick = fg.world.tick;
+            o = of;
+            if(stack>1) {
+                const unsigned char *px = ObsStack_done(&st);
+                if(f) fwrite(px,1,(size_t)st.k*st.size,f);
+            } else for(int y=0;f && y<o->h;++y) fwrite(o->px+y*o->pitch,1,o->w*o->channels,f);
+            continue;
+        }
+        TextureManager_begin_draw(fg.tM);
+        FlappyGame_draw(&fg);
+        TextureManager_end_draw(fg.tM);
+        if(stack>1) {
+            o = &fg.screen_obs; // for the size report
+            const unsigned char *px = ObsStack_push(&st,o->px,W,H,o->pitch);
+            if(f) fwrite(px,1,(size_t)st.k*st.size,f);
+            continue;
+        }
+        o = FlappyGame_observe(&fg);
+        for(int y=0;f && y<o->h;++y) fwrite(o->px+y*o->pitch,1,o->w*o->channels,f);
+    }
+    if(stack>1) ObsStack_destroy(&st);
+    if(raster) Raster_destroy(&r);
+    double sec = FlappyGame_ms(t0)/1000;
+    if(o) printf("%d frames of %dx%dx%d in %.3fs (%.1f frames/s, %s)\n",frames,o->w,o->h,o->channels,
+                 sec,sec>0 ? frames/sec : 0.0,raster ? "raster" : Obs_kernel());
+    if(f) fclose(f);
+    FlappyGame_destroy(&fg);
+    return 0;
+}
+
+// --bench: headless sim cases, then drawing offscreen on SDL's software
+// renderer, results as JSON
+void FlappyGame_bench_font(void *ctx,int iters) {
+    FlappyGame *fg = (FlappyGame*) ctx;
+    for(int z=0;z<iters;++z) {
+        FontManager_draw(fg->fM,FtArial,"Press space/enter/click to flap",ClBlack,100,320);
+        SpriteBatch_flush(&fg->tM->batch);
+    }
+}
+void FlappyGame_bench_frame(void *ctx,int iters) {
+    FlappyGame *fg = (FlappyGame*) ctx;
+    for(int z=0;z<iters;++z) {
         TextureManager_begin_draw(fg->tM);
         FlappyGame_draw(fg);
         TextureManager_end_draw(fg->tM);
-        fr = SDL_GetTicks()-fr;
-        if (fr<fg->FrRate) SDL_Delay(fg->FrRate-fr);
     }
 }
+struct FlappyBenchObs {
+    const ObsFrame *screen;
+    ObsFrame *out;
+};
+void FlappyGame_bench_obs(void *ctx,int iters) {
+    FlappyBenchObs *o = (FlappyBenchObs*) ctx;
+    for(int z=0;z<iters;++z) Obs_convert(o->screen->px,W,H,o->screen->pitch,o->out);
+}
+// 400x400 frame to 84x84 gray on every kernel, each must match the scalar
+// reference on a real frame
+int FlappyGame_bench_obs_all(Bench *b,FlappyGame *fg) {
+    ObsSpec spec = {84,84,true};
+    ObsPool p;
+    ObsPool_init(&p,&spec,2);
+    FlappyBenchObs o = {FlappyGame_observe(fg),ObsPool_next(&p)};
+    ObsFrame *ref = ObsPool_next(&p);
+    Obs_convert_scalar(o.screen->px,W,H,o.screen->pitch,ref);
+    static const char *kernels[] = {"scalar","sse2","avx2"};
+    const char *was = Obs_kernel();
+    int bad = 0;
+    for(int z=0;z<3;++z) {
+        if(!Obs_use_kernel(kernels[z])) continue;
+        char name[32];
+        snprintf(name,sizeof(name),"obs_gray84_%s",kernels[z]);
+        Bench_run(b,name,FlappyGame_bench_obs,&o,1);
+        for(int y=0;y<ref->h;++y)
+            if(memcmp(ref->px+y*ref->pitch,o.out->px+y*o.out->pitch,ref->w)) {
+                printf("Obs kernel %s differs from the reference\n",kernels[z]);
+                ++bad;
+                break;
+            }
+    }
+    Obs_use_kernel(was);
+    ObsPool_destroy(&p);
+    return bad;
+}
+struct FlappyBenchRaster {
+    Raster r;
+    const SimWorld *w;
+    ObsFrame *out;
+};
+void FlappyGame_bench_raster(void *ctx,int iters) {
+    FlappyBenchRaster *o = (FlappyBenchRaster*) ctx;
+    for(int z=0;z<iters;++z) Raster_draw(&o->r,o->w,o->out);
+}
+// state-only 84x84 gray against the downscaled frame, 1 when the layout
+// drifted: point sampling pre-filtered sprites only differs from the area
+// average along edges, never by the full contrast of a misplaced sprite
+enum EBenchRaster { RasterMaxDiff = 160 };
+const double RasterMeanDiff = 2;
+int FlappyGame_bench_raster_gray84(Bench *b,FlappyGame *fg) {
+    ObsSpec spec = {84,84,true};
+    ObsPool p;
+    ObsPool_init(&p,&spec,2);
+    FlappyBenchRaster o;
+    FlappyGame_raster_init(fg,&o.r,&spec);
+    o.w = &fg->view;
+    o.out = ObsPool_next(&p);
+    const ObsFrame *s = FlappyGame_observe(fg);
+    ObsFrame *ref = ObsPool_next(&p);
+    Obs_convert(s->px,W,H,s->pitch,ref);
+    Bench_run(b,"raster_gray84",FlappyGame_bench_raster,&o,1);
+    long diff = 0;
+    int most = 0;
+    for(int y=0;y<ref->h;++y)
+        for(int x=0;x<ref->w;++x) {
+            int d = abs(ref->px[y*ref->pitch+x]-o.out->px[y*o.out->pitch+x]);
+            diff += d;
+            if(d>most) most = d;
+        }
+    double mean = (double)diff/(ref->w*ref->h);
+    printf("raster_gray84 difference to the rendered frame: mean %.3f max %d\n",mean,most);
+    bool bad = mean>=RasterMeanDiff || most>RasterMaxDiff;
+    if(bad) printf("Raster differs from the rendered frame (mean limit %.1f, max limit %d)\n",
+                   RasterMeanDiff,(int)RasterMaxDiff);
+    Raster_destroy(&o.r);
+    ObsPool_destroy(&p);
+    return bad;
+}
+int FlappyGame_bench(const char *out) {
+    FILE *f = fopen(out,"w");
+    if(!f) {
+        printf("Failed to open '%s'\n",out);
+        return 1;
+    }
+    Bench b;
+    Bench_init(&b,f,0.1);
+    int bad = Bench_sim(&b);
+    FlappyGame fg;
+    FlappyGame_init_offscreen(&fg,SimVariants,1,0,0);
+    puts("");
+    ScrollingBackground_play(fg.bg); // pipes on screen, bird mid air
+    for(int z=0;z<60;++z) SimWorld_tick_scroll(&fg.world);
+    fg.view = fg.world;
+    fg.state = GsPLAY;
+    Bench_run(&b,"font_draw_31ch",FlappyGame_bench_font,&fg,1);
+    Bench_run(&b,"frame_software",FlappyGame_bench_frame,&fg,1);
+    bad += FlappyGame_bench_obs_all(&b,&fg);
+    bad += FlappyGame_bench_raster_gray84(&b,&fg);
+    Bench_end(&b);
+    fclose(f);
+    FlappyGame_destroy(&fg);
+    printf("Results written to %s\n",out);
+    return bad ? 2 : 0;
+}
 
-int main() {
+// --spectate: one game of a --serve server drawn with FlappyGame_draw,
+// interpolated between the last two ticks received like local play
+int FlappyGame_spectate(const char *host,int port,int game) {
+    SpecSocket ss;
+    SpecView sv;
+    SpecView_init(&sv);
+    if(!SpecSocket_open(&ss,host,port)) return 1;
+    printf("Waiting for %s:%d\n",host,port);
+    for(int z=0;z<50 && sv.variant<0;++z) SpecSocket_poll(&ss,&sv,100);
+    if(sv.variant<0) {
+        puts("No game server answered");
+        SpecSocket_close(&ss);
+        return 1;
+    }
+    const SimVariant *var = SimVariants+sv.variant;
+    FlappyGame fg;
+    FlappyGame_init(&fg,var,0,0,0);
+    fg.state = GsPLAY;
+    const Uint64 freq = SDL_GetPerformanceFrequency(), step = freq/var->fps;
+    Uint64 got = SDL_GetPerformanceCounter();
+    unsigned tick = 0;
+    while(true) {
+        Uint64 now = SDL_GetPerformanceCounter();
+        Profiler_frame(&fg.prof,fg.tM->batch.calls,0);
+        FlappyGame_check_input(&fg);
+        if(fg.state==GsEXIT) break;
+        SpecSocket_poll(&ss,&sv,0);
+        if(game<(int)sv.w.size() && sv.ok[game] && sv.w[game].tick!=tick) {
+            const SimWorld *w = &sv.w[game];
+            fg.prev = w->tick==tick+1 ? fg.world : *w; // after a loss, nothing to interpolate from
+            fg.world = *w;
+            tick = w->tick;
+            got = now;
+        }
+        fg.state = GsPLAY; // flaps of the spectator are ignored
+        fg.var->lerp(&fg.prev,&fg.world,now-got<step ? (double)(now-got)/step : 1.0,&fg.view);
+        TextureManager_begin_draw(fg.tM);
+        FlappyGame_draw(&fg);
+        if(fg.prof.overlay) FlappyGame_draw_prof(&fg);
+        TextureManager_end_draw(fg.tM);
+        if(SDL_GetPerformanceCounter()-now<freq/1000) SDL_Delay(1); // no vsync
+    }
+    printf("%llu datagrams, %llu games held after a loss\n",sv.dgrams,sv.held);
+    FlappyGame_destroy(&fg);
+    SpecSocket_close(&ss);
+    return 0;
+}
+
+// value after a --name command line option, 0 when absent
+const char *Arg_get(int argc,char *argv[],const char *name) {
+    for(int z=1;z<argc;++z)
+        if(!strcmp(argv[z],name)) return z+1<argc ? argv[z+1] : "";
+    return 0;
+}
+// like Arg_get for options whose value may be left out, "" when the next
+// token is another option
+const char *Arg_opt(int argc,char *argv[],const char *name) {
+    const char *v = Arg_get(argc,argv,name);
+    return v && !strncmp(v,"--",2) ? "" : v;
+}
+int Arg_int(int argc,char *argv[],const char *name,int def) {
+    const char *v = Arg_get(argc,argv,name);
+    return v && *v ? atoi(v) : def;
+}
+
+// --variant name, the classic game when absent
+const SimVariant *Arg_variant(int argc,char *argv[]) {
+    const char *name = Arg_get(argc,argv,"--variant");
+    if(!name) return SimVariants;
+    const SimVariant *v = SimVariant_find(name);
+    if(!v) {
+        printf("Unknown variant '%s', one of:",name);
+        for(int z=0;z<SimVariantCount;++z) printf(" %s",SimVariants[z].name);
+        puts("");
+        exit(1);
+    }
+    return v;
+}
+
+int FlappyGame_main(int argc,char *argv[]) {
+    if(Arg_get(argc,argv,"--headless"))
+        return SimPool_run(Arg_int(argc,argv,"--worlds",65536),Arg_int(argc,argv,"--threads",0),
+                           Arg_int(argc,argv,"--chunk",4096),Arg_int(argc,argv,"--ticks",1000));
+    const char *pack = Arg_opt(argc,argv,"--pack");
+    if(pack) return FlappyGame_pack(*pack ? pack : "flappy.pak");
+    const char *bench = Arg_opt(argc,argv,"--bench");
+    if(bench) return FlappyGame_bench(*bench ? bench : "bench.json");
+    const SimVariant *var = Arg_variant(argc,argv);
+    if(Arg_get(argc,argv,"--offscreen")) {
+        int obs = Arg_int(argc,argv,"--obs",0);
+        ObsSpec spec = {obs>0 ? obs : W,obs>0 ? obs : H,Arg_get(argc,argv,"--gray")!=0};
+        return FlappyGame_offscreen(var,Arg_int(argc,argv,"--frames",1000),obs>0 || spec.gray ? &spec : 0,
+                                    Arg_int(argc,argv,"--stack",1),Arg_get(argc,argv,"--raster")!=0,
+                                    Arg_get(argc,argv,"--dump"));
+    }
+    if(Arg_get(argc,argv,"--serve"))
+        return Spec_serve(var,Arg_int(argc,argv,"--port",SpecPort),Arg_int(argc,argv,"--games",64),
+                          Arg_int(argc,argv,"--seconds",0));
+    const char *spec = Arg_opt(argc,argv,"--spectate");
+    if(spec) {
+        const char *host = *spec ? spec : "127.0.0.1";
+        int port = Arg_int(argc,argv,"--port",SpecPort), clients = Arg_int(argc,argv,"--clients",0);
+        if(clients>0) return Spec_load(host,port,clients,Arg_int(argc,argv,"--seconds",10));
+        return FlappyGame_spectate(host,port,Arg_int(argc,argv,"--game",0));
+    }
+    const char *replay = Arg_get(argc,argv,"--replay");
+    if(replay) return Replay_run(replay,Arg_int(argc,argv,"--threads",0));
+    const char *seed = Arg_get(argc,argv,"--seed"), *record = Arg_get(argc,argv,"--record");
+    if(record && var!=SimVariants) {
+        puts("Replays are checked against the classic rules, --record needs the classic variant");
+        return 1;
+    }
     FlappyGame g;
-    FlappyGame_init(&g);
+    FlappyGame_init(&g,var,seed && *seed ? strtoul(seed,0,10) : time(0),record,Arg_get(argc,argv,"--trace"));
+    g.always_draw = Arg_get(argc,argv,"--always-draw")!=0;
     FlappyGame_play(&g);
     FlappyGame_destroy(&g);
+    return 0;
+}
+// --metrics [file] applies to every mode, exit() elsewhere still makes the
+// last write through Metrics_start's atexit handler
+int main(int argc,char *argv[]) {
+    Metrics_start(Arg_opt(argc,argv,"--metrics"));
+    int ret = FlappyGame_main(argc,argv);
+    Metrics_stop();
+    return ret;
 }
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "metrics.h"
+#include "sim.h"
+
+using namespace std;
+
+const int MetricsScoreLe[MetricsScoreBuckets] = {0,1,2,5,10,20,50,100,200,500};
+const double MetricsFrameLe[MetricsFrameBuckets] = {1,2,4,8,16,33,50,100,250}; // ms
+static const char MetricsCause[CrashTotal][8] = {"ground","ceiling","pipe"};
+
+// sum of shards
+struct MetricsTotal {
+    unsigned long long ticks, episodes, points, frames, frame_us;
+    unsigned long long crash[CrashTotal];
+    unsigned long long score[MetricsScoreBuckets+1], frame[MetricsFrameBuckets+1];
+};
+static unsigned long long Metrics_get(const MetricsCounter &c) {
+    return c.load(memory_order_relaxed);
+}
+static void Metrics_sum(MetricsTotal *t,const MetricsShard *s) {
+    t->ticks += Metrics_get(s->ticks);
+    t->episodes += Metrics_get(s->episodes);
+    t->points += Metrics_get(s->points);
+    t->frames += Metrics_get(s->frames);
+    t->frame_us += Metrics_get(s->frame_us);
+    for(int k=0;k<CrashTotal;++k) t->crash[k] += Metrics_get(s->crash[k]);
+    for(int k=0;k<=MetricsScoreBuckets;++k) t->score[k] += Metrics_get(s->score[k]);
+    for(int k=0;k<=MetricsFrameBuckets;++k) t->frame[k] += Metrics_get(s->frame[k]);
+}
+
+static MetricsShard MetricsShards[MetricsMaxThreads];
+MetricsShard *const MetricsShared = MetricsShards+MetricsMaxThreads-1;
+// a shard goes back on the free list when its thread exits, its counts
+// move to MetricsRetired first, so pools created over and over reuse the
+// same shards instead of ending up on MetricsShared
+// the lock is only taken on a thread's first count, at its exit and by
+// the exporter
+static mutex MetricsLock;
+static int MetricsUsed = 0; // shards ever handed out
+static vector<MetricsShard*> MetricsFree;
+static MetricsTotal MetricsRetired;
+
+struct MetricsHolder {
+    MetricsShard *s;
+    ~MetricsHolder() {
+        if(!s || s==MetricsShared) return;
+        lock_guard<mutex> lock(MetricsLock);
+        Metrics_sum(&MetricsRetired,s);
+        memset((void*)s,0,sizeof(MetricsShard));
+        MetricsFree.push_back(s);
+    }
+};
+static thread_local MetricsHolder MetricsMine;
+
+MetricsShard *Metrics_local() {
+    MetricsHolder *h = &MetricsMine;
+    if(h->s) return h->s;
+    lock_guard<mutex> lock(MetricsLock);
+    if(!MetricsFree.empty()) {
+        h->s = MetricsFree.back();
+        MetricsFree.pop_back();
+    } else h->s = MetricsUsed<MetricsMaxThreads-1 ? MetricsShards+MetricsUsed++ : MetricsShared;
+    return h->s;
+}
+void Metrics_episode(MetricsShard *s,int point,int y) {
+    int cause = y<0 ? CrashCeiling : y+SimBirdH>=H-SimGroundH ? CrashGround : CrashPipe;
+    int b = 0;
+    while(b<MetricsScoreBuckets && point>MetricsScoreLe[b]) ++b;
+    Metrics_add(s,s->episodes,1);
+    Metrics_add(s,s->points,point);
+    Metrics_add(s,s->crash[cause],1);
+    Metrics_add(s,s->score[b],1);
+}
+void Metrics_frame(MetricsShard *s,double ms) {
+    int b = 0;
+    while(b<MetricsFrameBuckets && ms>MetricsFrameLe[b]) ++b;
+    Metrics_add(s,s->frames,1);
+    Metrics_add(s,s->frame_us,(unsigned long long)(ms*1000));
+    Metrics_add(s,s->frame[b],1);
+}
+
+// live shards and retired threads
+static void Metrics_total(MetricsTotal *t) {
+    lock_guard<mutex> lock(MetricsLock);
+    *t = MetricsRetired;
+    for(int z=0;z<MetricsUsed;++z) Metrics_sum(t,MetricsShards+z);
+    Metrics_sum(t,MetricsShared);
+}
+static void Metrics_head(FILE *f,const char *name,const char *type,const char *help) {
+    fprintf(f,"# HELP %s %s\n# TYPE %s %s\n",name,help,name,type);
+}
+void Metrics_write(FILE *f,double ticks_per_sec) {
+    MetricsTotal t;
+    Metrics_total(&t);
+    Metrics_head(f,"flappy_ticks_total","counter","Simulation ticks stepped.");
+    fprintf(f,"flappy_ticks_total %llu\n",t.ticks);
+    Metrics_head(f,"flappy_ticks_per_second","gauge","Ticks per second since the previous write.");
+    fprintf(f,"flappy_ticks_per_second %.1f\n",ticks_per_sec);
+    Metrics_head(f,"flappy_episodes_total","counter","Episodes finished.");
+    fprintf(f,"flappy_episodes_total %llu\n",t.episodes);
+    Metrics_head(f,"flappy_crashes_total","counter","Episodes finished by crash cause.");
+    for(int k=0;k<CrashTotal;++k) fprintf(f,"flappy_crashes_total{cause=\"%s\"} %llu\n",MetricsCause[k],t.crash[k]);
+    Metrics_head(f,"flappy_score","histogram","Points of finished episodes.");
+    unsigned long long n = 0;
+    for(int k=0;k<MetricsScoreBuckets;++k)
+        fprintf(f,"flappy_score_bucket{le=\"%d\"} %llu\n",MetricsScoreLe[k],n += t.score[k]);
+    fprintf(f,"flappy_score_bucket{le=\"+Inf\"} %llu\n",n += t.score[MetricsScoreBuckets]);
+    fprintf(f,"flappy_score_sum %llu\nflappy_score_count %llu\n",t.points,t.episodes);
+    Metrics_head(f,"flappy_frame_seconds","histogram","Time between presented frames.");
+    n = 0;
+    for(int k=0;k<MetricsFrameBuckets;++k)
+        fprintf(f,"flappy_frame_seconds_bucket{le=\"%g\"} %llu\n",MetricsFrameLe[k]/1000,n += t.frame[k]);
+    fprintf(f,"flappy_frame_seconds_bucket{le=\"+Inf\"} %llu\n",n += t.frame[MetricsFrameBuckets]);
+    fprintf(f,"flappy_frame_seconds_sum %.6f\nflappy_frame_seconds_count %llu\n",t.frame_us/1e6,t.frames);
+}
+
+struct MetricsExporter {
+    mutex m;
+    condition_variable wake;
+    thread th;
+    bool quit;
+    const char *path;
+    unsigned long long ticks; // at the previous write
+    chrono::steady_clock::time_point t;
+};
+static MetricsExporter MetricsExp;
+
+// written beside and renamed over path, a reader never sees half a file
+static void Metrics_flush(MetricsExporter *e) {
+    MetricsTotal t;
+    Metrics_total(&t);
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    double sec = chrono::duration<double>(now-e->t).count();
+    double rate = sec>0 ? (t.ticks-e->ticks)/sec : 0;
+    e->ticks = t.ticks;
+    e->t = now;
+    char tmp[1024];
+    snprintf(tmp,sizeof(tmp),"%s.tmp",e->path);
+    FILE *f = fopen(tmp,"w");
+    if(!f) {
+        printf("Failed to write metrics '%s'\n",tmp);
+        return;
+    }
+    Metrics_write(f,rate);
+    if(fclose(f)) return;
+#ifdef _WIN32
+    remove(e->path);
+#endif
+    rename(tmp,e->path);
+}
+static void Metrics_run(MetricsExporter *e) {
+    unique_lock<mutex> lock(e->m);
+    while(true) {
+        bool quit = e->wake.wait_for(lock,chrono::seconds(MetricsFlush),[e]{ return e->quit; });
+        Metrics_flush(e);
+        if(quit) return;
+    }
+}
+// exit() from anywhere else (Escape in the menu, error1/error2) would
+// destroy MetricsExp with the thread still joinable and terminate
+static void Metrics_atexit() {
+    Metrics_stop();
+}
+void Metrics_start(const char *path) {
+    MetricsExporter *e = &MetricsExp;
+    if(!path) return;
+    static bool registered = false;
+    if(!registered) registered = !atexit(Metrics_atexit);
+    e->path = *path ? path : "flappy.prom";
+    e->quit = false;
+    e->ticks = 0;
+    e->t = chrono::steady_clock::now();
+    e->th = thread(Metrics_run,e);
+}
+void Metrics_stop() {
+    MetricsExporter *e = &MetricsExp;
+    if(!e->th.joinable()) return;
+    {
+        lock_guard<mutex> lock(e->m);
+        e->quit = true;
+    }
+    e->wake.notify_one();
+    e->th.join();
+}
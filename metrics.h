@@ -0,0 +1,49 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+
+#include <atomic>
+
+// process metrics
+// every thread counts into its own cache line aligned shard; only that
+// thread writes it, with relaxed loads and stores and no locked
+// instruction, and the exporter thread sums the shards when it writes
+// --metrics path is rewritten every MetricsFlush seconds in the Prometheus
+// text format (node_exporter textfile collector or any scraper of the file)
+// hot loops should count in locals and add once per chunk
+enum EMetrics { MetricsMaxThreads = 256, MetricsFlush = 5,
+                MetricsScoreBuckets = 10, MetricsFrameBuckets = 9 };
+enum ECrash { CrashGround, CrashCeiling, CrashPipe, CrashTotal };
+typedef std::atomic<unsigned long long> MetricsCounter;
+struct alignas(64) MetricsShard {
+    MetricsCounter ticks, episodes, points, frames, frame_us;
+    MetricsCounter crash[CrashTotal];
+    MetricsCounter score[MetricsScoreBuckets+1], frame[MetricsFrameBuckets+1]; // last is +Inf
+};
+extern const int MetricsScoreLe[MetricsScoreBuckets];
+extern const double MetricsFrameLe[MetricsFrameBuckets];
+extern MetricsShard *const MetricsShared; // the last, for threads while MetricsMaxThreads-1 others hold one
+
+// shard of the calling thread, handed out on first use and recycled when
+// the thread exits
+MetricsShard *Metrics_local();
+inline void Metrics_add(MetricsShard *s,MetricsCounter &c,unsigned long long n) {
+    if(s==MetricsShared) c.fetch_add(n,std::memory_order_relaxed);
+    else c.store(c.load(std::memory_order_relaxed)+n,std::memory_order_relaxed);
+}
+inline void Metrics_ticks(MetricsShard *s,unsigned long long n) {
+    Metrics_add(s,s->ticks,n);
+}
+// an episode ended with the bird at y, the crash cause follows from y
+void Metrics_episode(MetricsShard *s,int point,int y);
+void Metrics_frame(MetricsShard *s,double ms);
+
+// exporter thread, 0 path writes nothing; stopped at exit() too
+void Metrics_start(const char *path);
+// final write, joins the thread
+void Metrics_stop();
+// all shards in the Prometheus text format, ticks_per_sec as a gauge
+void Metrics_write(FILE *f,double ticks_per_sec);
+
+#endif // METRICS_H
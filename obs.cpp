@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "obs.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OBS_X86 1
+#include <immintrin.h>
+#endif
+
+void ObsPool_init(ObsPool *p,const ObsSpec *spec,int n) {
+    p->spec = *spec;
+    p->n = n>0 ? n : 1;
+    p->next = 0;
+    int ch = spec->gray ? 1 : 4, pitch = (spec->w*ch+15)&~15;
+    p->f = (ObsFrame*) calloc(p->n,sizeof(ObsFrame));
+    p->mem = (unsigned char*) calloc((size_t)p->n*pitch*spec->h,1);
+    if(!p->f || !p->mem) {
+        puts("Out of memory for observation frames");
+        exit(4);
+    }
+    for(int z=0;z<p->n;++z) {
+        ObsFrame *f = p->f+z;
+        f->px = p->mem+(size_t)z*pitch*spec->h;
+        f->w = spec->w;
+        f->h = spec->h;
+        f->pitch = pitch;
+        f->channels = ch;
+    }
+}
+void ObsPool_destroy(ObsPool *p) {
+    free(p->mem);
+    free(p->f);
+}
+ObsFrame *ObsPool_next(ObsPool *p) {
+    ObsFrame *f = p->f+p->next;
+    p->next = (p->next+1)%p->n;
+    return f;
+}
+
+// BT.601 luma in 8.8 fixed point
+static inline int Obs_gray(const unsigned char *c) {
+    return (77*c[0]+150*c[1]+29*c[2])>>8;
+}
+void Obs_convert_scalar(const unsigned char *rgba,int sw,int sh,int pitch,ObsFrame *out) {
+    for(int y=0;y<out->h;++y) {
+        int y0 = y*sh/out->h, y1 = (y+1)*sh/out->h;
+        if(y1==y0) ++y1; // upscaling repeats source pixels
+        unsigned char *d = out->px+y*out->pitch;
+        for(int x=0;x<out->w;++x) {
+            int x0 = x*sw/out->w, x1 = (x+1)*sw/out->w;
+            if(x1==x0) ++x1;
+            int n = (x1-x0)*(y1-y0);
+            unsigned sum[4] = {0,0,0,0};
+            for(int sy=y0;sy<y1;++sy) {
+                const unsigned char *s = rgba+sy*pitch+x0*4;
+                for(int sx=x0;sx<x1;++sx,s+=4) {
+                    if(out->channels==1) sum[0] += Obs_gray(s);
+                    else for(int k=0;k<4;++k) sum[k] += s[k];
+                }
+            }
+            for(int k=0;k<out->channels;++k) d[x*out->channels+k] = (sum[k]+n/2)/n;
+        }
+    }
+}
+
+// grayscale is done in two passes: source rows of a box are converted and
+// summed into 16-bit column sums (the SIMD part, every source pixel once),
+// then each output pixel adds its columns and rounds like the reference
+enum EObs { ObsMaxW = 4096, ObsMaxRows = 257 }; // 257*255 fits 16 bits
+typedef void (*ObsRowFn)(const unsigned char *s,unsigned short *col,int sw,bool first);
+static void Obs_gray_boxes(const unsigned char *rgba,int sw,int sh,int pitch,ObsFrame *out,ObsRowFn row) {
+    unsigned short col[ObsMaxW];
+    for(int y=0;y<out->h;++y) {
+        int y0 = y*sh/out->h, y1 = (y+1)*sh/out->h;
+        if(y1==y0) ++y1;
+        for(int sy=y0;sy<y1;++sy) row(rgba+sy*pitch,col,sw,sy==y0);
+        unsigned char *d = out->px+y*out->pitch;
+        for(int x=0;x<out->w;++x) {
+            int x0 = x*sw/out->w, x1 = (x+1)*sw/out->w;
+            if(x1==x0) ++x1;
+            unsigned sum = 0, n = (x1-x0)*(y1-y0);
+            for(int sx=x0;sx<x1;++sx) sum += col[sx];
+            d[x] = (sum+n/2)/n;
+        }
+    }
+}
+
+#ifdef OBS_X86
+// 8 pixels to 8 lumas in 16-bit lanes, 77*255+150*255+29*255 fits
+__attribute__((target("sse2")))
+static inline __m128i Obs_gray8_sse2(const unsigned char *s) {
+    const __m128i lo = _mm_set1_epi32(0xff);
+    __m128i a = _mm_loadu_si128((const __m128i*)s), b = _mm_loadu_si128((const __m128i*)(s+16));
+    __m128i r = _mm_packs_epi32(_mm_and_si128(a,lo),_mm_and_si128(b,lo));
+    __m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a,8),lo),_mm_and_si128(_mm_srli_epi32(b,8),lo));
+    __m128i c = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a,16),lo),_mm_and_si128(_mm_srli_epi32(b,16),lo));
+    __m128i l = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r,_mm_set1_epi16(77)),
+                                            _mm_mullo_epi16(g,_mm_set1_epi16(150))),
+                              _mm_mullo_epi16(c,_mm_set1_epi16(29)));
+    return _mm_srli_epi16(l,8);
+}
+__attribute__((target("sse2")))
+static void Obs_row_sse2(const unsigned char *s,unsigned short *col,int sw,bool first) {
+    int x = 0;
+    for(;x+8<=sw;x+=8) {
+        __m128i l = Obs_gray8_sse2(s+x*4);
+        if(!first) l = _mm_add_epi16(l,_mm_loadu_si128((const __m128i*)(col+x)));
+        _mm_storeu_si128((__m128i*)(col+x),l);
+    }
+    for(;x<sw;++x) col[x] = (first ? 0 : col[x]) + Obs_gray(s+x*4);
+}
+// same with 16 pixels, packs works per 128-bit half so the result is
+// put back in order once at the end
+__attribute__((target("avx2")))
+static inline __m256i Obs_gray16_avx2(const unsigned char *s) {
+    const __m256i lo = _mm256_set1_epi32(0xff);
+    __m256i a = _mm256_loadu_si256((const __m256i*)s), b = _mm256_loadu_si256((const __m256i*)(s+32));
+    __m256i r = _mm256_packs_epi32(_mm256_and_si256(a,lo),_mm256_and_si256(b,lo));
+    __m256i g = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(a,8),lo),_mm256_and_si256(_mm256_srli_epi32(b,8),lo));
+    __m256i c = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(a,16),lo),_mm256_and_si256(_mm256_srli_epi32(b,16),lo));
+    __m256i l = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(r,_mm256_set1_epi16(77)),
+                                                  _mm256_mullo_epi16(g,_mm256_set1_epi16(150))),
+                                 _mm256_mullo_epi16(c,_mm256_set1_epi16(29)));
+    return _mm256_permute4x64_epi64(_mm256_srli_epi16(l,8),0xD8);
+}
+__attribute__((target("avx2")))
+static void Obs_row_avx2(const unsigned char *s,unsigned short *col,int sw,bool first) {
+    int x = 0;
+    for(;x+16<=sw;x+=16) {
+        __m256i l = Obs_gray16_avx2(s+x*4);
+        if(!first) l = _mm256_add_epi16(l,_mm256_loadu_si256((const __m256i*)(col+x)));
+        _mm256_storeu_si256((__m256i*)(col+x),l);
+    }
+    for(;x<sw;++x) col[x] = (first ? 0 : col[x]) + Obs_gray(s+x*4);
+}
+#endif // OBS_X86
+
+struct ObsKernelEntry {
+    const char *name;
+    ObsRowFn fn; // 0 for the scalar reference
+};
+static ObsKernelEntry Obs_pick() {
+#ifdef OBS_X86
+    __builtin_cpu_init(); // runs before main
+    if(__builtin_cpu_supports("avx2")) return {"avx2",Obs_row_avx2};
+    if(__builtin_cpu_supports("sse2")) return {"sse2",Obs_row_sse2};
+#endif
+    return {"scalar",0};
+}
+static ObsKernelEntry obs_kernel = Obs_pick();
+
+bool Obs_use_kernel(const char *name) {
+    if(!strcmp(name,"scalar")) obs_kernel = {"scalar",0};
+#ifdef OBS_X86
+    else if(!strcmp(name,"sse2") && __builtin_cpu_supports("sse2")) obs_kernel = {"sse2",Obs_row_sse2};
+    else if(!strcmp(name,"avx2") && __builtin_cpu_supports("avx2")) obs_kernel = {"avx2",Obs_row_avx2};
+#endif
+    else return false;
+    return true;
+}
+const char *Obs_kernel() {
+    return obs_kernel.name;
+}
+// color frames and boxes too tall for the column sums use the reference
+void Obs_convert(const unsigned char *rgba,int sw,int sh,int pitch,ObsFrame *out) {
+    if(!obs_kernel.fn || out->channels!=1 || sw>ObsMaxW || sh/out->h+1>ObsMaxRows)
+        Obs_convert_scalar(rgba,sw,sh,pitch,out);
+    else
+        Obs_gray_boxes(rgba,sw,sh,pitch,out,obs_kernel.fn);
+}
+
+void ObsStack_init(ObsStack *s,const ObsSpec *spec,int k) {
+    s->spec = *spec;
+    s->k = k>0 ? k : 1;
+    s->size = spec->w*spec->h*(spec->gray ? 1 : 4);
+    s->mem = (unsigned char*) calloc((size_t)2*s->k*s->size,1);
+    if(!s->mem) {
+        puts("Out of memory for observation frames");
+        exit(4);
+    }
+    ObsStack_clear(s);
+}
+void ObsStack_destroy(ObsStack *s) {
+    free(s->mem);
+}
+void ObsStack_clear(ObsStack *s) {
+    s->head = s->k-1;
+    s->empty = true;
+}
+ObsFrame ObsStack_next(ObsStack *s) {
+    int ch = s->spec.gray ? 1 : 4, next = (s->head+1)%s->k;
+    ObsFrame f = {s->mem+(size_t)next*s->size,s->spec.w,s->spec.h,s->spec.w*ch,ch,0};
+    return f;
+}
+const unsigned char *ObsStack_done(ObsStack *s) {
+    s->head = (s->head+1)%s->k;
+    unsigned char *slot = s->mem+(size_t)s->head*s->size;
+    for(int z=0;z<2*s->k;++z)
+        if(z==s->head+s->k || (s->empty && z!=s->head)) memcpy(s->mem+(size_t)z*s->size,slot,s->size);
+    s->empty = false;
+    return s->mem+(size_t)(s->head+1)*s->size;
+}
+const unsigned char *ObsStack_push(ObsStack *s,const unsigned char *rgba,int sw,int sh,int pitch) {
+    ObsFrame f = ObsStack_next(s);
+    Obs_convert(rgba,sw,sh,pitch,&f);
+    return ObsStack_done(s);
+}
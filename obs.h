@@ -0,0 +1,57 @@
+#ifndef OBS_H
+#define OBS_H
+
+// observation frames
+// a drawn RGBA32 frame is turned into what an agent trains on: full size
+// or area-downscaled, color or grayscale, written into frames of a pool
+// allocated once, so stepping never allocates
+struct ObsSpec {
+    int w, h; // W, H keeps the full frame
+    bool gray; // 1 byte per pixel, else RGBA32
+};
+struct ObsFrame {
+    unsigned char *px;
+    int w, h, pitch, channels;
+    unsigned tick; // SimWorld tick the frame shows
+};
+// frames are handed out round robin, the oldest is overwritten first, so
+// the last n frames stay valid for the caller
+struct ObsPool {
+    ObsSpec spec;
+    ObsFrame *f;
+    int n, next;
+    unsigned char *mem;
+};
+void ObsPool_init(ObsPool *p,const ObsSpec *spec,int n);
+void ObsPool_destroy(ObsPool *p);
+ObsFrame *ObsPool_next(ObsPool *p);
+// rgba: sw x sh RGBA32, each output pixel averages its box of source pixels
+// grayscale runs on the AVX2 or SSE2 kernel when the cpu has it, the
+// scalar reference gives bit-identical results
+void Obs_convert(const unsigned char *rgba,int sw,int sh,int pitch,ObsFrame *out);
+void Obs_convert_scalar(const unsigned char *rgba,int sw,int sh,int pitch,ObsFrame *out);
+// "avx2", "sse2" or "scalar", false when not supported by this cpu
+bool Obs_use_kernel(const char *name);
+const char *Obs_kernel();
+
+// frame stacking: the last k observations as one contiguous k x h x w(x4)
+// block, oldest first, rows without padding
+// every frame is kept twice in a ring of 2k, so the newest k always sit
+// next to each other and nothing is shifted
+struct ObsStack {
+    ObsSpec spec;
+    int k, head, size; // frames kept, newest slot, bytes per frame
+    bool empty;
+    unsigned char *mem;
+};
+void ObsStack_init(ObsStack *s,const ObsSpec *spec,int k);
+void ObsStack_destroy(ObsStack *s);
+// new episode: the next push fills the whole stack with its frame
+void ObsStack_clear(ObsStack *s);
+const unsigned char *ObsStack_push(ObsStack *s,const unsigned char *rgba,int sw,int sh,int pitch);
+// the same in two steps, for frames drawn some other way: fill the frame
+// from ObsStack_next, then ObsStack_done returns the stack
+ObsFrame ObsStack_next(ObsStack *s);
+const unsigned char *ObsStack_done(ObsStack *s);
+
+#endif // OBS_H
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "profiler.h"
+
+using namespace std;
+
+static const char ProfNames[ProfZones][8] = {"input","tick","draw","present"};
+
+static int Profiler_kept(unsigned n) {
+    return n<(unsigned)ProfHistory ? (int)n : (int)ProfHistory;
+}
+static double Profiler_ring_percentile(const double *ring,unsigned count,double pct) {
+    int n = Profiler_kept(count);
+    if(!n) return 0;
+    double tmp[ProfHistory];
+    memcpy(tmp,ring,n*sizeof(double));
+    int k = (int)(pct/100*(n-1)+0.5);
+    nth_element(tmp,tmp+k,tmp+n);
+    return tmp[k];
+}
+
+double Profiler_now() {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+void Profiler_init(Profiler *p,bool tracing) {
+    p->t0 = p->frame_t0 = Profiler_now();
+    memset(p->zone_ms,0,sizeof(p->zone_ms));
+    memset(p->last_ms,0,sizeof(p->last_ms));
+    memset(p->frame_ms,0,sizeof(p->frame_ms));
+    p->frames = p->idle = p->inputs = 0;
+    p->draw_calls = p->uploads = 0;
+    p->overlay = false;
+    p->tracing = tracing;
+    p->trace.clear();
+}
+void Profiler_frame(Profiler *p,int draw_calls,int uploads) {
+    double now = Profiler_now();
+    p->frame_ms[p->frames++%ProfHistory] = (now-p->frame_t0)*1000;
+    p->frame_t0 = now;
+    memcpy(p->last_ms,p->zone_ms,sizeof(p->zone_ms));
+    memset(p->zone_ms,0,sizeof(p->zone_ms));
+    p->draw_calls = draw_calls;
+    p->uploads = uploads;
+}
+void Profiler_idle(Profiler *p) {
+    ++p->idle;
+    p->frame_t0 = Profiler_now();
+    memset(p->zone_ms,0,sizeof(p->zone_ms));
+}
+void Profiler_add(Profiler *p,int zone,double begin,double end) {
+    p->zone_ms[zone] += (end-begin)*1000;
+    if(!p->tracing || p->trace.size()>=ProfMaxEvents) return;
+    ProfEvent e = {zone,(begin-p->t0)*1e6,(end-begin)*1e6};
+    p->trace.push_back(e);
+}
+void Profiler_input(Profiler *p,double ms) {
+    p->input_ms[p->inputs++%ProfHistory] = ms;
+}
+double Profiler_percentile(const Profiler *p,double pct) {
+    return Profiler_ring_percentile(p->frame_ms,p->frames,pct);
+}
+double Profiler_input_percentile(const Profiler *p,double pct) {
+    return Profiler_ring_percentile(p->input_ms,p->inputs,pct);
+}
+void Profiler_report(const Profiler *p) {
+    printf("%u frames (%u idle turns skipped), last %d: p50 %.2fms p99 %.2fms\n",p->frames,p->idle,
+           Profiler_kept(p->frames),Profiler_percentile(p,50),Profiler_percentile(p,99));
+    if(p->inputs)
+        printf("%u flaps, last %d input to tick: p50 %.2fms p99 %.2fms\n",p->inputs,Profiler_kept(p->inputs),
+               Profiler_input_percentile(p,50),Profiler_input_percentile(p,99));
+}
+bool Profiler_write_trace(const Profiler *p,const char *path) {
+    FILE *f = fopen(path,"w");
+    if(!f) return false;
+    fputs("{\"traceEvents\":[\n",f);
+    for(size_t z=0;z<p->trace.size();++z) {
+        const ProfEvent &e = p->trace[z];
+        fprintf(f,"{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}%s\n",
+                ProfNames[e.zone],e.begin,e.dur,z+1<p->trace.size() ? "," : "");
+    }
+    fputs("],\"displayTimeUnit\":\"ms\"}\n",f);
+    return fclose(f)==0;
+}
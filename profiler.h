@@ -0,0 +1,52 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <vector>
+
+// frame profiler
+// zones are timed with a monotonic high resolution clock, every frame
+// keeps its per-zone times and the last ProfHistory frames are kept for
+// percentiles, optionally every zone is logged for a Chrome trace
+// (chrome://tracing or ui.perfetto.dev)
+enum EProf { ProfInput, ProfTick, ProfDraw, ProfPresent, ProfZones };
+enum EProfLimit { ProfHistory = 256, ProfMaxEvents = 1<<20 };
+struct ProfEvent {
+    int zone;
+    double begin, dur; // microseconds since Profiler_init
+};
+struct Profiler {
+    double t0, frame_t0; // seconds, clock of Profiler_now
+    double zone_ms[ProfZones], last_ms[ProfZones]; // current and last frame
+    double frame_ms[ProfHistory]; // ring, frames%ProfHistory is next
+    unsigned frames, idle; // idle: loop turns that drew nothing
+    double input_ms[ProfHistory]; // ring of flap latencies, inputs%ProfHistory is next
+    unsigned inputs;
+    int draw_calls, uploads; // last frame
+    bool overlay, tracing;
+    std::vector<ProfEvent> trace;
+};
+double Profiler_now();
+void Profiler_init(Profiler *p,bool tracing);
+// closes the previous frame and starts the next one
+void Profiler_frame(Profiler *p,int draw_calls,int uploads);
+// drops the zones of a turn that skipped drawing, idle time is not frame time
+void Profiler_idle(Profiler *p);
+void Profiler_add(Profiler *p,int zone,double begin,double end);
+// time from the press of a flap to the tick that applied it
+void Profiler_input(Profiler *p,double ms);
+// percentile 0..100 of the kept frame times, in ms
+double Profiler_percentile(const Profiler *p,double pct);
+double Profiler_input_percentile(const Profiler *p,double pct);
+void Profiler_report(const Profiler *p);
+bool Profiler_write_trace(const Profiler *p,const char *path);
+
+// times the enclosing block
+struct ProfScope {
+    Profiler *p;
+    int zone;
+    double begin;
+    ProfScope(Profiler *p,int zone) : p(p), zone(zone), begin(Profiler_now()) {}
+    ~ProfScope() { Profiler_add(p,zone,begin,Profiler_now()); }
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "raster.h"
+
+using namespace std;
+
+const char RsFiles[RsTotal][24] = { // urutan harus sama dengan ERs
+                                    "background.png",
+                                    "ground.png",
+                                    "obstacle_top.png",
+                                    "obstacle_bottom.png",
+                                    "avatar.png"
+                                  };
+
+// box filter of k taps around every pixel, on premultiplied RGBA
+// background and ground wrap horizontally like they scroll, sprites are
+// transparent outside
+static void Raster_filter(const RasterImage *img,int k,bool wrap,vector<unsigned> &out) {
+    int w = img->w, h = img->h, lo = k/2;
+    vector<unsigned> pm(w*h*4), tmp(w*h*4);
+    for(int y=0;y<h;++y)
+        for(int x=0;x<w;++x) {
+            const unsigned char *s = img->px+y*img->pitch+x*4;
+            unsigned *d = &pm[(y*w+x)*4];
+            for(int c=0;c<3;++c) d[c] = (s[c]*s[3]+127)/255;
+            d[3] = s[3];
+        }
+    for(int y=0;y<h;++y)
+        for(int x=0;x<w;++x) {
+            unsigned sum[4] = {0,0,0,0};
+            for(int t=x-lo;t<x-lo+k;++t) {
+                int sx = wrap ? (t%w+w)%w : t;
+                if(sx<0 || sx>=w) continue;
+                for(int c=0;c<4;++c) sum[c] += pm[(y*w+sx)*4+c];
+            }
+            for(int c=0;c<4;++c) tmp[(y*w+x)*4+c] = sum[c];
+        }
+    out.assign(w*h*4,0);
+    for(int y=0;y<h;++y)
+        for(int x=0;x<w;++x) {
+            unsigned sum[4] = {0,0,0,0};
+            for(int t=y-lo;t<y-lo+k;++t) {
+                int sy = wrap ? (t<0 ? 0 : t>=h ? h-1 : t) : t;
+                if(sy<0 || sy>=h) continue;
+                for(int c=0;c<4;++c) sum[c] += tmp[(sy*w+x)*4+c];
+            }
+            for(int c=0;c<4;++c) out[(y*w+x)*4+c] = (sum[c]+k*k/2)/(k*k);
+        }
+}
+static void Raster_sprite(RasterSprite *s,const RasterImage *img,int k,bool wrap,bool gray) {
+    vector<unsigned> f;
+    Raster_filter(img,k,wrap,f);
+    s->w = img->w;
+    s->h = img->h;
+    s->ch = gray ? 2 : 4;
+    s->px = (unsigned char*) malloc((size_t)s->w*s->h*s->ch);
+    if(!s->px) {
+        puts("Out of memory for raster sprites");
+        exit(4);
+    }
+    for(int z=0;z<s->w*s->h;++z) {
+        const unsigned *c = &f[z*4];
+        unsigned char *d = s->px+z*s->ch;
+        if(gray) {
+            d[0] = (77*c[0]+150*c[1]+29*c[2])>>8;
+            d[1] = c[3];
+        } else for(int k=0;k<4;++k) d[k] = c[k];
+    }
+}
+
+bool Raster_init(Raster *r,const ObsSpec *spec,const RasterImage img[RsTotal]) {
+    memset(r,0,sizeof(Raster));
+    // every row reads the background, also those under the ground
+    if(img[RsBG].w<W || img[RsBG].h<H || img[RsGround].w<W || img[RsGround].h!=SimGroundH
+            || img[RsTPipe].w!=SimPipeW || img[RsBPipe].w!=SimPipeW
+            || img[RsBird].w!=SimBirdW || img[RsBird].h!=SimBirdH)
+        return false;
+    if(spec->w<1 || spec->h<1 || spec->w>RsMaxSide || spec->h>RsMaxSide) return false;
+    r->spec = *spec;
+    r->space = SimSpace;
+    int k = (W+spec->w/2)/spec->w;
+    if(k<1) k = 1;
+    for(int z=0;z<RsTotal;++z) Raster_sprite(r->s+z,img+z,k,z<=RsGround,spec->gray);
+    r->cx = (int*) malloc(spec->w*sizeof(int));
+    r->cy = (int*) malloc(spec->h*sizeof(int));
+    if(!r->cx || !r->cy) {
+        puts("Out of memory for raster sprites");
+        exit(4);
+    }
+    for(int x=0;x<spec->w;++x) r->cx[x] = (x*W/spec->w+(x+1)*W/spec->w)/2;
+    for(int y=0;y<spec->h;++y) r->cy[y] = (y*H/spec->h+(y+1)*H/spec->h)/2;
+    return true;
+}
+void Raster_destroy(Raster *r) {
+    for(int z=0;z<RsTotal;++z) free(r->s[z].px);
+    free(r->cx);
+    free(r->cy);
+}
+
+// premultiplied src over dst, alpha is the last channel of the sprite
+template<int CH>
+static inline void Raster_over(unsigned char *d,const unsigned char *s) {
+    unsigned a = 255-s[CH-1];
+    for(int c=0;c<CH-1;++c) d[c] = s[c]+(d[c]*a+127)/255;
+}
+// pipes are further apart than they are wide, so a column shows at most one
+template<int CH>
+static void Raster_draw_ch(const Raster *r,const SimWorld *w,ObsFrame *out) {
+    const RasterSprite *bg = r->s+RsBG, *gr = r->s+RsGround, *tp = r->s+RsTPipe,
+            *bp = r->s+RsBPipe, *bd = r->s+RsBird;
+    const int gy = H-SimGroundH, ow = out->w<r->spec.w ? out->w : r->spec.w;
+    int sx[RsMaxSide], pipe[RsMaxSide];
+    for(int ox=0;ox<ow;++ox) {
+        int x = r->cx[ox];
+        sx[ox] = (x+w->scroll)%W;
+        pipe[ox] = -1;
+        for(int z=0;w->show_pipe && z<w->pipes;++z)
+            if(x>=w->pipe_x[z] && x<w->pipe_x[z]+SimPipeW) pipe[ox] = z;
+    }
+    for(int oy=0;oy<out->h && oy<r->spec.h;++oy) {
+        int y = r->cy[oy], by = y-w->y;
+        const unsigned char *bgr = bg->px+y*bg->w*CH, *grr = y>=gy ? gr->px+(y-gy)*gr->w*CH : 0;
+        unsigned char *row = out->px+oy*out->pitch;
+        for(int ox=0;ox<ow;++ox) {
+            unsigned char c[CH];
+            memcpy(c,bgr+sx[ox]*CH,CH);
+            if(pipe[ox]>=0) {
+                int z = pipe[ox], px = r->cx[ox]-w->pipe_x[z], up = w->pipe_up[z];
+                int ty = tp->h-up+y, py = y-up-r->space;
+                if(y<up && ty>=0) Raster_over<CH>(c,tp->px+(ty*tp->w+px)*CH);
+                else if(py>=0 && py<bp->h) Raster_over<CH>(c,bp->px+(py*bp->w+px)*CH);
+            }
+            if(grr) Raster_over<CH>(c,grr+sx[ox]*CH);
+            int bx = r->cx[ox]-SimBirdX;
+            if(bx>=0 && bx<SimBirdW && by>=0 && by<SimBirdH)
+                Raster_over<CH>(c,bd->px+(by*bd->w+bx)*CH);
+            if(CH==2) row[ox] = c[0];
+            else {
+                memcpy(row+ox*4,c,3);
+                row[ox*4+3] = 255;
+            }
+        }
+    }
+}
+// the frame takes the sprite format, gray or RGBA as in the spec
+void Raster_draw(const Raster *r,const SimWorld *w,ObsFrame *out) {
+    if(r->s[RsBG].ch==2) Raster_draw_ch<2>(r,w,out);
+    else Raster_draw_ch<4>(r,w,out);
+}
+
+bool Raster_bundle_images(const Bundle *pak,RasterImage img[RsTotal]) {
+    for(int z=0;z<RsTotal;++z) {
+        const BundleEntry *e = Bundle_find(pak,"i",RsFiles[z]);
+        if(!e || e->kind!=BkPixels) return false;
+        RasterImage i = {(const unsigned char*)Bundle_data(pak,e),(int)e->w,(int)e->h,(int)e->w*4};
+        img[z] = i;
+    }
+    return true;
+}
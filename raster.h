@@ -0,0 +1,40 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include "bundle.h"
+#include "obs.h"
+#include "sim.h"
+
+// state-only renderer for observations
+// the scene of FlappyGame_draw (scrolling background, pipes, ground, bird,
+// no text) is drawn straight from a SimWorld into an ObsFrame, without SDL
+// each output pixel samples the centre of its Obs_convert box, so every
+// edge lands on the same pixel as in the downscaled full frame; sprites
+// are box filtered once at init so their texture averages the same way
+enum ERs { RsBG, RsGround, RsTPipe, RsBPipe, RsBird, RsTotal };
+enum ERsLimit { RsMaxSide = 1024 };
+extern const char RsFiles[RsTotal][24];
+struct RasterImage {
+    const unsigned char *px; // RGBA32
+    int w, h, pitch;
+};
+// filtered sprite, premultiplied gray+alpha or RGBA
+struct RasterSprite {
+    unsigned char *px;
+    int w, h, ch;
+};
+struct Raster {
+    ObsSpec spec;
+    RasterSprite s[RsTotal];
+    int *cx, *cy; // sample point of every output column and row
+    int space; // pipe gap, SimSpace unless drawing another SimVariant
+};
+// false when a sprite size does not match the simulation or the spec is
+// larger than RsMaxSide
+bool Raster_init(Raster *r,const ObsSpec *spec,const RasterImage img[RsTotal]);
+void Raster_destroy(Raster *r);
+void Raster_draw(const Raster *r,const SimWorld *w,ObsFrame *out);
+// sprites from a bundle written by --pack, false when one is missing
+bool Raster_bundle_images(const Bundle *pak,RasterImage img[RsTotal]);
+
+#endif // RASTER_H
@@ -0,0 +1,162 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "replay.h"
+#include "sim_pool.h"
+
+using namespace std;
+
+static const char ReplayMagic[5] = {'F','L','P','R',1};
+
+static void Replay_put(vector<unsigned char> &out,unsigned v) {
+    for(;v>=0x80;v>>=7) out.push_back((unsigned char)(v|0x80));
+    out.push_back((unsigned char)v);
+}
+static unsigned Replay_zig(int v) { return ((unsigned)v<<1) ^ (unsigned)(v>>31); }
+static int Replay_unzig(unsigned v) { return (int)(v>>1) ^ -(int)(v&1); }
+
+// reading past the end sets p to 0
+struct ReplayCur {
+    const unsigned char *p, *end;
+};
+static unsigned Replay_get(ReplayCur *c) {
+    unsigned v = 0;
+    for(int s=0;c->p && s<35;s+=7) {
+        if(c->p>=c->end) break;
+        unsigned char b = *c->p++;
+        v |= (unsigned)(b&0x7f)<<s;
+        if(!(b&0x80)) return v;
+    }
+    c->p = 0;
+    return 0;
+}
+static bool ReplayRec_read(ReplayRec *r,ReplayCur *c) {
+    r->seed = Replay_get(c);
+    r->y = Replay_unzig(Replay_get(c));
+    r->vy = Replay_unzig(Replay_get(c));
+    unsigned n = Replay_get(c), t = 0;
+    if(!c->p || n>(unsigned)(c->end-c->p)) {
+        c->p = 0;
+        return false;
+    }
+    r->flaps.resize(n);
+    for(unsigned z=0;z<n;++z) r->flaps[z] = t += Replay_get(c);
+    r->point = Replay_get(c);
+    r->tick = Replay_get(c);
+    return c->p!=0;
+}
+
+void ReplayRec_begin(ReplayRec *r,const SimWorld *w) {
+    r->seed = w->seed;
+    r->y = w->y;
+    r->vy = w->vy;
+    r->flaps.clear();
+    r->point = 0;
+    r->tick = 0;
+}
+void ReplayRec_flap(ReplayRec *r,const SimWorld *w) {
+    if(r->flaps.empty() || r->flaps.back()!=w->tick) r->flaps.push_back(w->tick);
+}
+void ReplayRec_end(ReplayRec *r,const SimWorld *w) {
+    r->point = w->point;
+    r->tick = w->tick;
+}
+bool ReplayRec_write(const ReplayRec *r,FILE *f) {
+    vector<unsigned char> out;
+    fseek(f,0,SEEK_END);
+    if(ftell(f)==0) out.insert(out.end(),ReplayMagic,ReplayMagic+sizeof(ReplayMagic));
+    Replay_put(out,r->seed);
+    Replay_put(out,Replay_zig(r->y));
+    Replay_put(out,Replay_zig(r->vy));
+    Replay_put(out,r->flaps.size());
+    unsigned t = 0;
+    for(size_t z=0;z<r->flaps.size();++z) {
+        Replay_put(out,r->flaps[z]-t);
+        t = r->flaps[z];
+    }
+    Replay_put(out,r->point);
+    Replay_put(out,r->tick);
+    bool ok = fwrite(&out[0],1,out.size(),f)==out.size();
+    fflush(f);
+    return ok;
+}
+bool ReplayRec_check(const ReplayRec *r,SimWorld *w) {
+    SimWorld_start(w,r->seed);
+    w->y = r->y;
+    w->vy = r->vy;
+    size_t next = 0, n = r->flaps.size();
+    while(!w->done && w->tick<=r->tick) {
+        bool flap = next<n && r->flaps[next]==w->tick;
+        if(flap) ++next;
+        SimWorld_step(w,flap);
+    }
+    return w->done && w->point==r->point && w->tick==r->tick;
+}
+
+struct ReplayRun {
+    const unsigned char *buf, *end;
+    vector<size_t> offset;
+    unsigned char *ok;
+    unsigned long long *ticks; // per record, for the steps/sec report
+};
+static void Replay_run_chunk(void *ctx,int from,int to) {
+    ReplayRun *run = (ReplayRun*) ctx;
+    ReplayRec r;
+    SimWorld w;
+    for(int z=from;z<to;++z) {
+        ReplayCur c = {run->buf+run->offset[z],run->end};
+        bool read = ReplayRec_read(&r,&c);
+        run->ok[z] = read && ReplayRec_check(&r,&w);
+        run->ticks[z] = read ? w.tick : 0;
+    }
+}
+int Replay_run(const char *path,int threads) {
+    FILE *f = fopen(path,"rb");
+    if(!f) {
+        printf("Failed to open replay '%s'\n",path);
+        return 1;
+    }
+    vector<unsigned char> buf;
+    unsigned char tmp[1<<16];
+    for(size_t n;(n = fread(tmp,1,sizeof(tmp),f))>0;) buf.insert(buf.end(),tmp,tmp+n);
+    fclose(f);
+    if(buf.size()<sizeof(ReplayMagic) || memcmp(&buf[0],ReplayMagic,sizeof(ReplayMagic))) {
+        printf("Not a replay log '%s'\n",path);
+        return 1;
+    }
+    ReplayRun run;
+    run.buf = &buf[0];
+    run.end = run.buf+buf.size();
+    ReplayRec r;
+    ReplayCur c = {run.buf+sizeof(ReplayMagic),run.end};
+    while(c.p && c.p<c.end) {
+        run.offset.push_back(c.p-run.buf);
+        if(!ReplayRec_read(&r,&c)) {
+            printf("Truncated replay record %d\n",(int)run.offset.size());
+            run.offset.pop_back();
+        }
+    }
+    int n = run.offset.size();
+    run.ok = (unsigned char*) calloc(n+1,1);
+    run.ticks = (unsigned long long*) calloc(n+1,sizeof(unsigned long long));
+    SimPool p;
+    SimPool_init(&p,threads,256);
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    SimPool_for(&p,n,Replay_run_chunk,&run);
+    double sec = chrono::duration<double>(chrono::steady_clock::now()-t0).count();
+    SimPool_destroy(&p);
+    int bad = 0;
+    unsigned long long ticks = 0;
+    for(int z=0;z<n;++z) {
+        ticks += run.ticks[z];
+        if(run.ok[z]) continue;
+        if(++bad<=10) printf("Mismatch in session %d\n",z);
+    }
+    printf("%d sessions, %d mismatched, %llu ticks in %.3fs (%.2f Mticks/s)\n",
+           n,bad,ticks,sec,sec>0 ? ticks/sec/1e6 : 0.0);
+    free(run.ok);
+    free(run.ticks);
+    return bad ? 2 : 0;
+}
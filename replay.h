@@ -0,0 +1,34 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "sim.h"
+
+// input replay log
+// file: "FLPR" version, then one record per session, all numbers LEB128:
+// seed, start y, start vy (zigzag), flap count, flap ticks (delta),
+// score, crash tick
+// a flap at tick t is applied before step t+1, like Bird_jump before
+// FlappyGame_tick
+struct ReplayRec {
+    unsigned seed;
+    int y, vy; // bird after the menu, when play started
+    std::vector<unsigned> flaps;
+    int point;
+    unsigned tick; // tick of the crash
+};
+void ReplayRec_begin(ReplayRec *r,const SimWorld *w);
+void ReplayRec_flap(ReplayRec *r,const SimWorld *w);
+void ReplayRec_end(ReplayRec *r,const SimWorld *w);
+// appends, writing the file header first when the file is empty
+bool ReplayRec_write(const ReplayRec *r,FILE *f);
+// re-simulate headless as fast as possible, false when score or crash
+// tick differ from the log
+bool ReplayRec_check(const ReplayRec *r,SimWorld *w);
+// verify every session of a log, threads<=0 uses every core
+int Replay_run(const char *path,int threads);
+
+#endif // REPLAY_H
@@ -0,0 +1,63 @@
+#include <string.h>
+
+#include "sim_core.h"
+
+// scramble the seed so nearby seeds give unrelated streams,
+// xorshift state must never be 0
+unsigned Sim_seed(unsigned seed) {
+    seed += 0x9e3779b9u;
+    seed = (seed ^ seed>>16) * 0x85ebca6bu;
+    seed = (seed ^ seed>>13) * 0xc2b2ae35u;
+    seed ^= seed>>16;
+    return seed ? seed : 0x6d2b79f5u;
+}
+// xorshift32 per world, gap top in the old rand() range: 40..279
+int Sim_rand_up(unsigned *rng) {
+    unsigned x = *rng;
+    x ^= x<<13;
+    x ^= x>>17;
+    x ^= x<<5;
+    *rng = x;
+    return 40 + (int)((unsigned long long)x*240 >> 32);
+}
+
+void SimWorld_init(SimWorld *w,unsigned seed) { SimWorld_init<SimClassic>(w,seed); }
+void SimWorld_reset(SimWorld *w) { SimWorld_reset<SimClassic>(w); }
+void SimWorld_play(SimWorld *w) { SimWorld_play<SimClassic>(w); }
+void SimWorld_start(SimWorld *w,unsigned seed) { SimWorld_start<SimClassic>(w,seed); }
+void SimWorld_jump(SimWorld *w) { SimWorld_jump<SimClassic>(w); }
+void SimWorld_tick_bird(SimWorld *w) { SimWorld_tick_bird<SimClassic>(w); }
+void SimWorld_tick_scroll(SimWorld *w) { SimWorld_tick_scroll<SimClassic>(w); }
+int SimWorld_check_hit(SimWorld *w) { return SimWorld_check_hit<SimClassic>(w); }
+int SimWorld_step(SimWorld *w,bool flap) { return SimWorld_step<SimClassic>(w,flap); }
+void SimWorld_step_batch(SimWorld *w,const unsigned char *actions,int n) {
+    SimWorld_step_batch<SimClassic>(w,actions,n);
+}
+void SimWorld_lerp(const SimWorld *a,const SimWorld *b,double t,SimWorld *out) {
+    SimWorld_lerp<SimClassic>(a,b,t,out);
+}
+bool SimWorld_autopilot(const SimWorld *w) { return SimWorld_autopilot<SimClassic>(w); }
+
+#define SIM_VARIANT(name,C) { name,C::gravity,C::jump,C::speed,C::space,C::pipes,C::fps, \
+        SimWorld_init<C>,SimWorld_play<C>,SimWorld_start<C>,SimWorld_jump<C>,SimWorld_tick_bird<C>, \
+        SimWorld_tick_scroll<C>,SimWorld_step<C>,SimWorld_step_batch<C>,SimWorld_lerp<C>,SimWorld_autopilot<C> }
+
+// easiest first: floatier bird, slower scroll, wider gaps, fewer pipes
+typedef SimConfig<1,-7,2,110,2,20> SimEasy;
+typedef SimConfig<2,-10,4,80,4,25> SimFast;
+typedef SimConfig<2,-10,3,72,6,20> SimDense;
+typedef SimConfig<3,-12,5,76,5,30> SimHard;
+const SimVariant SimVariants[] = {
+    SIM_VARIANT("classic",SimClassic),
+    SIM_VARIANT("easy",SimEasy),
+    SIM_VARIANT("fast",SimFast),
+    SIM_VARIANT("dense",SimDense),
+    SIM_VARIANT("hard",SimHard),
+};
+const int SimVariantCount = sizeof(SimVariants)/sizeof(SimVariants[0]);
+
+const SimVariant *SimVariant_find(const char *name) {
+    for(int z=0;z<SimVariantCount;++z)
+        if(!strcmp(SimVariants[z].name,name)) return SimVariants+z;
+    return 0;
+}
@@ -0,0 +1,107 @@
+#ifndef SIM_H
+#define SIM_H
+
+// headless simulation core
+// no SDL, no audio, no allocation: the game and any number of
+// headless worlds (training, replays) step through the same code
+
+const int W = 400, H = 400;
+
+// sizes must match the sprites in i/, checked by FlappyGame_init
+// these are the classic game, SimVariant has the others; a world holds up
+// to SimMaxPipes pipes: they are (W+SimPipeW)/count apart and would
+// overlap beyond that
+enum ESim {
+    SimBirdX = 100, SimBirdY = 150, SimBirdW = 34, SimBirdH = 24,
+    SimPipeW = 52, SimGroundH = 48, SimPipes = 3, SimMaxPipes = 8,
+    SimSpeed = 3, SimSpace = 80, SimGravity = 2, SimJump = -10,
+};
+
+// events returned by SimWorld_step / SimWorld_check_hit
+enum ESimEv { SimEvPoint = 1, SimEvHit = 2 };
+
+// pipes form a ring ordered by x: head is the leftmost, the only one that
+// can scroll off and respawn at the right end; near is the first pipe not
+// yet behind the bird, hits and points only look from near while pipes
+// overlap the bird's column, whatever the pipe count
+struct SimWorld {
+    int y, vy; // bird top, bird velocity (pixel per tick)
+    int scroll; // background offset
+    int pipe_x[SimMaxPipes], pipe_up[SimMaxPipes]; // pipe left, gap top
+    int pipes, head, near; // pipe count, ring cursors
+    int point; // +1 for every pipe passed
+    unsigned tick;
+    unsigned seed, rng; // seed of this episode, xorshift state
+    bool show_pipe, done;
+};
+
+// no global state: an episode is reproduced exactly from its seed
+unsigned Sim_seed(unsigned seed);
+int Sim_rand_up(unsigned *rng);
+
+void SimWorld_init(SimWorld *w,unsigned seed);
+void SimWorld_reset(SimWorld *w);
+void SimWorld_play(SimWorld *w);
+void SimWorld_start(SimWorld *w,unsigned seed);
+void SimWorld_jump(SimWorld *w);
+void SimWorld_tick_bird(SimWorld *w);
+void SimWorld_tick_scroll(SimWorld *w);
+int SimWorld_check_hit(SimWorld *w);
+int SimWorld_step(SimWorld *w,bool flap);
+// advance n independent worlds by one tick, actions[i]!=0 flaps world i,
+// finished worlds are left untouched until restarted
+void SimWorld_step_batch(SimWorld *w,const unsigned char *actions,int n);
+void SimWorld_lerp(const SimWorld *a,const SimWorld *b,double t,SimWorld *out);
+// next pipe in the ring
+inline int SimWorld_next(const SimWorld *w,int z) { return z+1<w->pipes ? z+1 : 0; }
+// simple policy for benchmarks and demos: flap when sinking below the
+// middle of the next gap
+bool SimWorld_autopilot(const SimWorld *w);
+
+// game variants for curricula, picked by name at runtime
+// each entry is the core of sim_core.h instantiated with its constants,
+// a world must be stepped by the variant that initialized it
+struct SimVariant {
+    const char *name;
+    int gravity, flap, speed, space, pipes, fps; // flap: jump velocity
+    void (*init)(SimWorld *w,unsigned seed);
+    void (*play)(SimWorld *w);
+    void (*start)(SimWorld *w,unsigned seed);
+    void (*jump)(SimWorld *w);
+    void (*tick_bird)(SimWorld *w);
+    void (*tick_scroll)(SimWorld *w);
+    int (*step)(SimWorld *w,bool flap);
+    void (*step_batch)(SimWorld *w,const unsigned char *actions,int n);
+    void (*lerp)(const SimWorld *a,const SimWorld *b,double t,SimWorld *out);
+    bool (*autopilot)(const SimWorld *w);
+};
+extern const SimVariant SimVariants[]; // SimVariants[0] is the classic game
+extern const int SimVariantCount;
+// 0 when there is no such variant
+const SimVariant *SimVariant_find(const char *name);
+
+// structure of arrays for many worlds, lane i of every array is world i
+// stepped 8 (AVX2) or 4 (SSE2) worlds at a time, the scalar kernel gives
+// bit-identical results; every world has SimPipes pipes
+struct SimBatch {
+    int n;
+    int *y, *vy, *scroll, *point;
+    int *pipe_x[SimPipes], *pipe_up[SimPipes];
+    unsigned *tick, *seed, *rng;
+    int *done; // 0 or -1, usable as a SIMD mask
+    int *ev; // events of the last step
+    void *mem;
+};
+void SimBatch_init(SimBatch *b,int n);
+void SimBatch_destroy(SimBatch *b);
+void SimBatch_start(SimBatch *b,int i,unsigned seed);
+void SimBatch_get(const SimBatch *b,int i,SimWorld *w);
+void SimBatch_set(SimBatch *b,int i,const SimWorld *w);
+// step worlds from..to-1, actions indexed by world like the batch arrays
+void SimBatch_step_range(SimBatch *b,const unsigned char *actions,int from,int to);
+void SimBatch_step(SimBatch *b,const unsigned char *actions);
+// "avx2", "sse2" or "scalar", false when not supported by this cpu
+bool SimBatch_use_kernel(const char *name);
+const char *SimBatch_kernel();
+
+#endif // SIM_H
@@ -0,0 +1,288 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIM_X86 1
+#include <immintrin.h>
+#endif
+
+// batch worlds are always playing (pipes shown)
+// bird vs pipe is SDL_HasIntersection with the bird clipped by the
+// ground/ceiling test first: the pipe spans x-SimBirdW+1..x+SimPipeW-1 of
+// the bird's left edge, top pipe hits when y<up, bottom pipe when
+// y+SimBirdH>up+SimSpace
+static inline int SimBatch_lane(SimBatch *b,int i,bool flap) {
+    if(b->done[i]) return 0;
+    int ev = 0, y, hit;
+    if(flap) b->vy[i] = SimJump;
+    b->scroll[i] = (b->scroll[i] + SimSpeed) % W;
+    for(int z=0;z<SimPipes;++z) {
+        int x = (b->pipe_x[z][i] -= SimSpeed);
+        if(x+SimPipeW<0) {
+            b->pipe_x[z][i] = W;
+            b->pipe_up[z][i] = Sim_rand_up(&b->rng[i]);
+        }
+    }
+    y = (b->y[i] += b->vy[i]);
+    b->vy[i] += SimGravity;
+    ++b->tick[i];
+    for(int z=0;z<SimPipes;++z) {
+        int x = b->pipe_x[z][i];
+        if(x>SimBirdX && x<=SimBirdX+SimSpeed) ev = SimEvPoint;
+    }
+    b->point[i] += ev;
+    hit = y < 0 || y+SimBirdH >= H-SimGroundH;
+    for(int z=0;z<SimPipes;++z) {
+        int x = b->pipe_x[z][i], up = b->pipe_up[z][i];
+        hit |= x>SimBirdX-SimPipeW && x<SimBirdX+SimBirdW
+                && (y<up || y+SimBirdH>up+SimSpace);
+    }
+    if(hit) {
+        b->done[i] = -1;
+        ev |= SimEvHit;
+    }
+    return ev;
+}
+static void SimBatch_step_scalar(SimBatch *b,const unsigned char *actions,int from,int to) {
+    for(int i=from;i<to;++i) b->ev[i] = SimBatch_lane(b,i,actions[i]!=0);
+}
+
+// pipes leaving the screen need a new gap from the lane's own rng,
+// done per lane in pipe order so the rng sequence matches the scalar kernel
+static inline void SimBatch_respawn(SimBatch *b,int z,int i,unsigned mask) {
+    for(;mask;mask&=mask-1) {
+        int l = i + __builtin_ctz(mask);
+        b->pipe_x[z][l] = W;
+        b->pipe_up[z][l] = Sim_rand_up(&b->rng[l]);
+    }
+}
+
+#ifdef SIM_X86
+// lanes of 4 worlds, blend via and/andnot since SSE2 has no blendv
+#define SSE_LD(p) _mm_loadu_si128((const __m128i*)(p))
+#define SSE_ST(p,v) _mm_storeu_si128((__m128i*)(p),v)
+#define SSE_SEL(m,a,b) _mm_or_si128(_mm_and_si128(m,a),_mm_andnot_si128(m,b))
+__attribute__((target("sse2")))
+static void SimBatch_step_sse2(SimBatch *b,const unsigned char *actions,int from,int to) {
+    const __m128i zero = _mm_setzero_si128();
+    int i = from;
+    for(;i+4<=to;i+=4) {
+        __m128i done = SSE_LD(b->done+i);
+        if(_mm_movemask_epi8(done)==0xffff) {
+            SSE_ST(b->ev+i,zero);
+            continue;
+        }
+        __m128i live = _mm_andnot_si128(done,_mm_set1_epi32(-1));
+        int a4;
+        memcpy(&a4,actions+i,4);
+        __m128i act = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(a4),zero),zero);
+        act = _mm_andnot_si128(_mm_cmpeq_epi32(act,zero),live); // flap and alive
+        __m128i vy = SSE_LD(b->vy+i);
+        vy = SSE_SEL(act,_mm_set1_epi32(SimJump),vy);
+
+        __m128i s = _mm_add_epi32(SSE_LD(b->scroll+i),_mm_set1_epi32(SimSpeed));
+        s = _mm_sub_epi32(s,_mm_and_si128(_mm_cmpgt_epi32(s,_mm_set1_epi32(W-1)),_mm_set1_epi32(W)));
+        SSE_ST(b->scroll+i,SSE_SEL(live,s,SSE_LD(b->scroll+i)));
+        for(int z=0;z<SimPipes;++z) {
+            __m128i old = SSE_LD(b->pipe_x[z]+i);
+            __m128i x = SSE_SEL(live,_mm_sub_epi32(old,_mm_set1_epi32(SimSpeed)),old);
+            SSE_ST(b->pipe_x[z]+i,x);
+            __m128i off = _mm_and_si128(_mm_cmplt_epi32(x,_mm_set1_epi32(-SimPipeW)),live);
+            SimBatch_respawn(b,z,i,_mm_movemask_ps(_mm_castsi128_ps(off)));
+        }
+        __m128i y0 = SSE_LD(b->y+i);
+        __m128i y = SSE_SEL(live,_mm_add_epi32(y0,vy),y0);
+        vy = SSE_SEL(live,_mm_add_epi32(vy,_mm_set1_epi32(SimGravity)),SSE_LD(b->vy+i));
+        SSE_ST(b->y+i,y);
+        SSE_ST(b->vy+i,vy);
+        __m128i t = SSE_LD(b->tick+i);
+        SSE_ST(b->tick+i,_mm_sub_epi32(t,live));
+
+        __m128i pt = zero, hit = _mm_or_si128(_mm_cmplt_epi32(y,zero),
+                _mm_cmpgt_epi32(y,_mm_set1_epi32(H-SimGroundH-SimBirdH-1)));
+        __m128i yb = _mm_add_epi32(y,_mm_set1_epi32(SimBirdH));
+        for(int z=0;z<SimPipes;++z) {
+            __m128i x = SSE_LD(b->pipe_x[z]+i), up = SSE_LD(b->pipe_up[z]+i);
+            pt = _mm_or_si128(pt,_mm_and_si128(_mm_cmpgt_epi32(x,_mm_set1_epi32(SimBirdX)),
+                    _mm_cmplt_epi32(x,_mm_set1_epi32(SimBirdX+SimSpeed+1))));
+            __m128i col = _mm_and_si128(_mm_cmpgt_epi32(x,_mm_set1_epi32(SimBirdX-SimPipeW)),
+                    _mm_cmplt_epi32(x,_mm_set1_epi32(SimBirdX+SimBirdW)));
+            __m128i gap = _mm_or_si128(_mm_cmplt_epi32(y,up),
+                    _mm_cmpgt_epi32(yb,_mm_add_epi32(up,_mm_set1_epi32(SimSpace))));
+            hit = _mm_or_si128(hit,_mm_and_si128(col,gap));
+        }
+        pt = _mm_and_si128(pt,live);
+        hit = _mm_and_si128(hit,live);
+        SSE_ST(b->point+i,_mm_sub_epi32(SSE_LD(b->point+i),pt));
+        SSE_ST(b->done+i,_mm_or_si128(done,hit));
+        __m128i ev = _mm_or_si128(_mm_and_si128(pt,_mm_set1_epi32(SimEvPoint)),
+                _mm_and_si128(hit,_mm_set1_epi32(SimEvHit)));
+        SSE_ST(b->ev+i,ev);
+    }
+    SimBatch_step_scalar(b,actions,i,to);
+}
+
+// same kernel as SSE2 with 8 lanes
+#define AVX_LD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define AVX_ST(p,v) _mm256_storeu_si256((__m256i*)(p),v)
+#define AVX_SET(c) _mm256_set1_epi32(c)
+#define AVX_LT(a,b) _mm256_cmpgt_epi32(b,a)
+__attribute__((target("avx2")))
+static void SimBatch_step_avx2(SimBatch *b,const unsigned char *actions,int from,int to) {
+    const __m256i zero = _mm256_setzero_si256();
+    int i = from;
+    for(;i+8<=to;i+=8) {
+        __m256i done = AVX_LD(b->done+i);
+        if(_mm256_movemask_epi8(done)==-1) {
+            AVX_ST(b->ev+i,zero);
+            continue;
+        }
+        __m256i live = _mm256_xor_si256(done,AVX_SET(-1));
+        __m256i act = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(actions+i)));
+        act = _mm256_andnot_si256(_mm256_cmpeq_epi32(act,zero),live);
+        __m256i vy = _mm256_blendv_epi8(AVX_LD(b->vy+i),AVX_SET(SimJump),act);
+
+        __m256i s0 = AVX_LD(b->scroll+i), s = _mm256_add_epi32(s0,AVX_SET(SimSpeed));
+        s = _mm256_sub_epi32(s,_mm256_and_si256(_mm256_cmpgt_epi32(s,AVX_SET(W-1)),AVX_SET(W)));
+        AVX_ST(b->scroll+i,_mm256_blendv_epi8(s0,s,live));
+        for(int z=0;z<SimPipes;++z) {
+            __m256i old = AVX_LD(b->pipe_x[z]+i);
+            __m256i x = _mm256_blendv_epi8(old,_mm256_sub_epi32(old,AVX_SET(SimSpeed)),live);
+            AVX_ST(b->pipe_x[z]+i,x);
+            __m256i off = _mm256_and_si256(AVX_LT(x,AVX_SET(-SimPipeW)),live);
+            SimBatch_respawn(b,z,i,_mm256_movemask_ps(_mm256_castsi256_ps(off)));
+        }
+        __m256i y0 = AVX_LD(b->y+i);
+        __m256i y = _mm256_blendv_epi8(y0,_mm256_add_epi32(y0,vy),live);
+        vy = _mm256_blendv_epi8(AVX_LD(b->vy+i),_mm256_add_epi32(vy,AVX_SET(SimGravity)),live);
+        AVX_ST(b->y+i,y);
+        AVX_ST(b->vy+i,vy);
+        AVX_ST(b->tick+i,_mm256_sub_epi32(AVX_LD(b->tick+i),live));
+
+        __m256i pt = zero, hit = _mm256_or_si256(AVX_LT(y,zero),
+                _mm256_cmpgt_epi32(y,AVX_SET(H-SimGroundH-SimBirdH-1)));
+        __m256i yb = _mm256_add_epi32(y,AVX_SET(SimBirdH));
+        for(int z=0;z<SimPipes;++z) {
+            __m256i x = AVX_LD(b->pipe_x[z]+i), up = AVX_LD(b->pipe_up[z]+i);
+            pt = _mm256_or_si256(pt,_mm256_and_si256(_mm256_cmpgt_epi32(x,AVX_SET(SimBirdX)),
+                    AVX_LT(x,AVX_SET(SimBirdX+SimSpeed+1))));
+            __m256i col = _mm256_and_si256(_mm256_cmpgt_epi32(x,AVX_SET(SimBirdX-SimPipeW)),
+                    AVX_LT(x,AVX_SET(SimBirdX+SimBirdW)));
+            __m256i gap = _mm256_or_si256(AVX_LT(y,up),
+                    _mm256_cmpgt_epi32(yb,_mm256_add_epi32(up,AVX_SET(SimSpace))));
+            hit = _mm256_or_si256(hit,_mm256_and_si256(col,gap));
+        }
+        pt = _mm256_and_si256(pt,live);
+        hit = _mm256_and_si256(hit,live);
+        AVX_ST(b->point+i,_mm256_sub_epi32(AVX_LD(b->point+i),pt));
+        AVX_ST(b->done+i,_mm256_or_si256(done,hit));
+        __m256i ev = _mm256_or_si256(_mm256_and_si256(pt,AVX_SET(SimEvPoint)),
+                _mm256_and_si256(hit,AVX_SET(SimEvHit)));
+        AVX_ST(b->ev+i,ev);
+    }
+    SimBatch_step_scalar(b,actions,i,to);
+}
+#endif // SIM_X86
+
+typedef void (*SimBatchKernel)(SimBatch*,const unsigned char*,int,int);
+struct SimBatchKernelEntry {
+    const char *name;
+    SimBatchKernel fn;
+};
+static SimBatchKernelEntry SimBatch_pick() {
+#ifdef SIM_X86
+    __builtin_cpu_init(); // runs before main
+    if(__builtin_cpu_supports("avx2")) return {"avx2",SimBatch_step_avx2};
+    if(__builtin_cpu_supports("sse2")) return {"sse2",SimBatch_step_sse2};
+#endif
+    return {"scalar",SimBatch_step_scalar};
+}
+static SimBatchKernelEntry kernel = SimBatch_pick();
+
+bool SimBatch_use_kernel(const char *name) {
+    if(!strcmp(name,"scalar")) kernel = {"scalar",SimBatch_step_scalar};
+#ifdef SIM_X86
+    else if(!strcmp(name,"sse2") && __builtin_cpu_supports("sse2")) kernel = {"sse2",SimBatch_step_sse2};
+    else if(!strcmp(name,"avx2") && __builtin_cpu_supports("avx2")) kernel = {"avx2",SimBatch_step_avx2};
+#endif
+    else return false;
+    return true;
+}
+const char *SimBatch_kernel() {
+    return kernel.name;
+}
+
+void SimBatch_init(SimBatch *b,int n) {
+    const int arrays = 9 + 2*SimPipes;
+    int *mem = (int*) calloc((size_t)arrays*n,sizeof(int));
+    if(!mem && n) exit(4);
+    b->n = n;
+    b->mem = mem;
+    b->y = mem; mem += n;
+    b->vy = mem; mem += n;
+    b->scroll = mem; mem += n;
+    b->point = mem; mem += n;
+    b->done = mem; mem += n;
+    b->ev = mem; mem += n;
+    b->tick = (unsigned*) mem; mem += n;
+    b->seed = (unsigned*) mem; mem += n;
+    b->rng = (unsigned*) mem; mem += n;
+    for(int z=0;z<SimPipes;++z) {
+        b->pipe_x[z] = mem; mem += n;
+        b->pipe_up[z] = mem; mem += n;
+    }
+}
+void SimBatch_destroy(SimBatch *b) {
+    free(b->mem);
+    b->mem = 0;
+    b->n = 0;
+}
+void SimBatch_start(SimBatch *b,int i,unsigned seed) {
+    SimWorld w;
+    SimWorld_start(&w,seed);
+    SimBatch_set(b,i,&w);
+}
+void SimBatch_get(const SimBatch *b,int i,SimWorld *w) {
+    w->y = b->y[i];
+    w->vy = b->vy[i];
+    w->scroll = b->scroll[i];
+    w->point = b->point[i];
+    w->tick = b->tick[i];
+    w->seed = b->seed[i];
+    w->rng = b->rng[i];
+    w->show_pipe = true;
+    w->done = b->done[i]!=0;
+    for(int z=0;z<SimPipes;++z) {
+        w->pipe_x[z] = b->pipe_x[z][i];
+        w->pipe_up[z] = b->pipe_up[z][i];
+    }
+    // pipes respawn in place like in SimWorld, the ring is the x order
+    w->pipes = SimPipes;
+    w->head = 0;
+    for(int z=1;z<SimPipes;++z) if(w->pipe_x[z]<w->pipe_x[w->head]) w->head = z;
+    w->near = w->head;
+    for(int k=1;k<SimPipes && w->pipe_x[w->near]+SimPipeW<=SimBirdX;++k) w->near = SimWorld_next(w,w->near);
+}
+void SimBatch_set(SimBatch *b,int i,const SimWorld *w) {
+    b->y[i] = w->y;
+    b->vy[i] = w->vy;
+    b->scroll[i] = w->scroll;
+    b->point[i] = w->point;
+    b->tick[i] = w->tick;
+    b->seed[i] = w->seed;
+    b->rng[i] = w->rng;
+    b->done[i] = w->done ? -1 : 0;
+    b->ev[i] = 0;
+    for(int z=0;z<SimPipes;++z) {
+        b->pipe_x[z][i] = w->pipe_x[z];
+        b->pipe_up[z][i] = w->pipe_up[z];
+    }
+}
+void SimBatch_step_range(SimBatch *b,const unsigned char *actions,int from,int to) {
+    kernel.fn(b,actions,from,to);
+}
+void SimBatch_step(SimBatch *b,const unsigned char *actions) {
+    kernel.fn(b,actions,0,b->n);
+}
@@ -0,0 +1,127 @@
+#ifndef SIM_CORE_H
+#define SIM_CORE_H
+
+#include "sim.h"
+
+// simulation core, instantiated per game variant
+// C is a SimConfig: every tunable is a compile-time constant, so each
+// instantiation folds them and unrolls the pipe loops; the plain SimWorld_*
+// functions are SimWorld_*<SimClassic>
+template<int Gravity,int Jump,int Speed,int Space,int Pipes,int FPS>
+struct SimConfig {
+    static constexpr int gravity = Gravity, jump = Jump, speed = Speed, space = Space,
+            pipes = Pipes, fps = FPS;
+    // pipes must not overlap and a pipe must be scored while it is still
+    // in the bird's column
+    static_assert(Pipes>=1 && Pipes<=SimMaxPipes,"pipe count");
+    static_assert(Speed>0 && Speed<SimBirdW,"scroll speed");
+    static_assert(Space>SimBirdH && Space<H-SimGroundH,"gap");
+    static_assert(Gravity>0 && Jump<0 && FPS>0,"physics");
+};
+typedef SimConfig<SimGravity,SimJump,SimSpeed,SimSpace,SimPipes,20> SimClassic;
+
+// same rule as SDL_HasIntersection
+inline bool Sim_intersect(int ax,int ay,int aw,int ah,int bx,int by,int bw,int bh) {
+    if(aw<=0 || ah<=0 || bw<=0 || bh<=0) return false;
+    return ax < bx+bw && bx < ax+aw && ay < by+bh && by < ay+ah;
+}
+inline void SimWorld_reset_pipe(SimWorld *w,int z,int left) {
+    w->pipe_x[z] = left;
+    w->pipe_up[z] = Sim_rand_up(&w->rng);
+}
+
+template<class C> void SimWorld_reset(SimWorld *w) {
+    w->y = SimBirdY;
+    w->vy = 0;
+    w->scroll = 0;
+    w->point = 0;
+    w->tick = 0;
+    w->show_pipe = false;
+    w->done = false;
+    w->pipes = C::pipes;
+    w->head = w->near = 0;
+    for(int z=0;z<C::pipes;++z) SimWorld_reset_pipe(w,z,W);
+}
+template<class C> void SimWorld_init(SimWorld *w,unsigned seed) {
+    w->seed = seed;
+    w->rng = Sim_seed(seed);
+    SimWorld_reset<C>(w);
+}
+template<class C> void SimWorld_play(SimWorld *w) {
+    w->show_pipe = true;
+    w->head = w->near = 0;
+    int s = W + SimPipeW;
+    for(int z=0;z<C::pipes;++z) SimWorld_reset_pipe(w,z,W+s*z/C::pipes);
+}
+template<class C> void SimWorld_start(SimWorld *w,unsigned seed) {
+    SimWorld_init<C>(w,seed);
+    SimWorld_play<C>(w);
+}
+template<class C> void SimWorld_jump(SimWorld *w) {
+    w->vy = C::jump;
+}
+template<class C> void SimWorld_tick_bird(SimWorld *w) {
+    w->y += w->vy;
+    w->vy += C::gravity;
+}
+template<class C> void SimWorld_tick_scroll(SimWorld *w) {
+    w->scroll = (w->scroll + C::speed) % W;
+    if(!w->show_pipe) return;
+    for(int z=0;z<C::pipes;++z) w->pipe_x[z] -= C::speed;
+    // pipes are further apart than the speed, at most one leaves per tick
+    if(w->pipe_x[w->head]+SimPipeW<0) {
+        SimWorld_reset_pipe(w,w->head,W);
+        w->head = SimWorld_next(w,w->head);
+    }
+    for(int k=1;k<C::pipes && w->pipe_x[w->near]+SimPipeW<=SimBirdX;++k)
+        w->near = SimWorld_next(w,w->near);
+}
+template<class C> int SimWorld_check_hit(SimWorld *w) {
+    int ev = 0, y = w->y;
+    for(int k=0,z=w->near;k<C::pipes && w->pipe_x[z]<SimBirdX+SimBirdW;++k,z=SimWorld_next(w,z)) {
+        int x = w->pipe_x[z];
+        if(x>SimBirdX && x<=SimBirdX+C::speed) {
+            w->point += 1;
+            ev |= SimEvPoint;
+            break;
+        }
+    }
+    if(y < 0 || y+SimBirdH >= H-SimGroundH) return ev | SimEvHit;
+    for(int k=0,z=w->near;k<C::pipes && w->pipe_x[z]<SimBirdX+SimBirdW;++k,z=SimWorld_next(w,z)) {
+        int x = w->pipe_x[z], up = w->pipe_up[z];
+        if(Sim_intersect(SimBirdX,y,SimBirdW,SimBirdH,x,0,SimPipeW,up)
+                || Sim_intersect(SimBirdX,y,SimBirdW,SimBirdH,x,up+C::space,SimPipeW,H-up-C::space))
+            return ev | SimEvHit;
+    }
+    return ev;
+}
+template<class C> int SimWorld_step(SimWorld *w,bool flap) {
+    if(w->done) return 0;
+    if(flap) SimWorld_jump<C>(w);
+    SimWorld_tick_scroll<C>(w);
+    SimWorld_tick_bird<C>(w);
+    ++w->tick;
+    int ev = SimWorld_check_hit<C>(w);
+    if(ev & SimEvHit) w->done = true;
+    return ev;
+}
+template<class C> void SimWorld_step_batch(SimWorld *w,const unsigned char *actions,int n) {
+    for(int z=0;z<n;++z) SimWorld_step<C>(w+z,actions[z]!=0);
+}
+// world between two consecutive ticks for drawing, t in 0..1
+// whatever jumped instead of moving (respawned pipe, new episode) snaps to b
+template<class C> void SimWorld_lerp(const SimWorld *a,const SimWorld *b,double t,SimWorld *out) {
+    *out = *b;
+    out->y = a->y + (int)((b->y-a->y)*t);
+    int ds = (b->scroll-a->scroll+W)%W;
+    if(ds<=C::speed) out->scroll = (a->scroll + (int)(ds*t))%W;
+    for(int z=0;z<C::pipes;++z)
+        if(a->pipe_x[z]-b->pipe_x[z]==C::speed)
+            out->pipe_x[z] = a->pipe_x[z] - (int)(C::speed*t);
+}
+template<class C> bool SimWorld_autopilot(const SimWorld *w) {
+    int up = w->pipe_x[w->near]<W ? w->pipe_up[w->near] : H/2;
+    return w->vy>=0 && w->y+SimBirdH>up+C::space-SimBirdH/2;
+}
+
+#endif // SIM_CORE_H
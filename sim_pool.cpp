@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "sim_pool.h"
+#include "metrics.h"
+
+using namespace std;
+
+typedef chrono::steady_clock SimClock;
+
+static double Sim_seconds(SimClock::time_point from) {
+    return chrono::duration<double>(SimClock::now()-from).count();
+}
+
+// chunk share of one thread: head<<32|tail, owner takes from the head,
+// thieves from the tail, both by CAS so the last chunk is taken once
+// range is padded on both sides instead of alignas(64), new does not align
+// past 16 before C++17: thieves CAS it, the owner writes st after every chunk
+struct SimPoolThread {
+    atomic<unsigned long long> range;
+    char pad_range[64-sizeof(atomic<unsigned long long>)];
+    thread th;
+    SimPoolStat st;
+    char pad[64]; // keep the next range off this cache line
+};
+struct SimPoolShared {
+    mutex m;
+    condition_variable go, done;
+    unsigned gen;
+    int pending;
+    bool quit;
+    int n;
+    SimPoolFn fn;
+    void *ctx;
+};
+
+static int SimPool_take(SimPoolThread *t,bool steal) {
+    unsigned long long r = t->range.load(memory_order_relaxed);
+    for(;;) {
+        unsigned head = r>>32, tail = (unsigned)r;
+        if(head>=tail) return -1;
+        unsigned long long nr = steal ? r-1 : r+(1ull<<32);
+        if(t->range.compare_exchange_weak(r,nr)) return steal ? tail-1 : head;
+    }
+}
+static void SimPool_chunk(SimPool *p,SimPoolThread *t,int c) {
+    SimPoolShared *sh = p->sh;
+    int from = c*p->chunk, to = from+p->chunk;
+    if(to>sh->n) to = sh->n;
+    SimClock::time_point t0 = SimClock::now();
+    sh->fn(sh->ctx,from,to);
+    t->st.busy += Sim_seconds(t0);
+    t->st.items += to-from;
+}
+static void SimPool_work(SimPool *p,int id) {
+    SimPoolThread *t = p->th+id;
+    int c;
+    while((c = SimPool_take(t,false))>=0) SimPool_chunk(p,t,c);
+    for(int k=1;k<p->threads;++k) {
+        SimPoolThread *v = p->th+(id+k)%p->threads;
+        while((c = SimPool_take(v,true))>=0) {
+            ++t->st.steals;
+            SimPool_chunk(p,t,c);
+        }
+    }
+}
+static void SimPool_loop(SimPool *p,int id) {
+    SimPoolShared *sh = p->sh;
+    unsigned seen = 0;
+    for(;;) {
+        {
+            unique_lock<mutex> lk(sh->m);
+            sh->go.wait(lk,[&]{ return sh->quit || sh->gen!=seen; });
+            if(sh->quit) return;
+            seen = sh->gen;
+        }
+        SimPool_work(p,id);
+        lock_guard<mutex> lk(sh->m);
+        if(--sh->pending==0) sh->done.notify_one();
+    }
+}
+
+void SimPool_init(SimPool *p,int threads,int chunk) {
+    if(threads<=0) threads = thread::hardware_concurrency();
+    if(threads<=0) threads = 1;
+    p->threads = threads;
+    p->chunk = chunk>0 ? chunk : 1024;
+    p->sh = new SimPoolShared();
+    p->sh->gen = 0;
+    p->sh->pending = 0;
+    p->sh->quit = false;
+    p->th = new SimPoolThread[threads];
+    for(int z=0;z<threads;++z) {
+        p->th[z].range = 0;
+        p->th[z].st = SimPoolStat();
+    }
+    for(int z=1;z<threads;++z) p->th[z].th = thread(SimPool_loop,p,z);
+}
+void SimPool_destroy(SimPool *p) {
+    {
+        lock_guard<mutex> lk(p->sh->m);
+        p->sh->quit = true;
+    }
+    p->sh->go.notify_all();
+    for(int z=1;z<p->threads;++z) p->th[z].th.join();
+    delete[] p->th;
+    delete p->sh;
+}
+void SimPool_for(SimPool *p,int n,SimPoolFn fn,void *ctx) {
+    SimPoolShared *sh = p->sh;
+    unsigned chunks = (n+p->chunk-1)/p->chunk, T = p->threads;
+    for(unsigned z=0;z<T;++z)
+        p->th[z].range = (unsigned long long)(chunks*z/T)<<32 | chunks*(z+1)/T;
+    {
+        lock_guard<mutex> lk(sh->m);
+        sh->n = n;
+        sh->fn = fn;
+        sh->ctx = ctx;
+        sh->pending = T-1;
+        ++sh->gen;
+    }
+    sh->go.notify_all();
+    SimPool_work(p,0);
+    unique_lock<mutex> lk(sh->m);
+    sh->done.wait(lk,[&]{ return sh->pending==0; });
+}
+
+struct SimPoolStep {
+    SimBatch *b;
+    const unsigned char *actions;
+};
+static void SimPool_step_chunk(void *ctx,int from,int to) {
+    SimPoolStep *s = (SimPoolStep*) ctx;
+    SimBatch_step_range(s->b,s->actions,from,to);
+}
+void SimPool_step(SimPool *p,SimBatch *b,const unsigned char *actions) {
+    SimPoolStep s = {b,actions};
+    SimPool_for(p,b->n,SimPool_step_chunk,&s);
+}
+void SimPool_stat(const SimPool *p,int t,SimPoolStat *st) {
+    *st = p->th[t].st;
+}
+void SimPool_report(const SimPool *p,double wall) {
+    unsigned long long total = 0;
+    for(int z=0;z<p->threads;++z) {
+        const SimPoolStat &st = p->th[z].st;
+        total += st.items;
+        printf("thread %2d: %12llu steps %8.2f Msteps/s busy %5.1f%% stolen %llu\n",z,st.items,
+               st.busy>0 ? st.items/st.busy/1e6 : 0.0,wall>0 ? 100*st.busy/wall : 0.0,st.steals);
+    }
+    printf("total: %llu steps in %.3fs, %.2f Msteps/s on %d threads (chunk %d, kernel %s)\n",
+           total,wall,wall>0 ? total/wall/1e6 : 0.0,p->threads,p->chunk,SimBatch_kernel());
+}
+
+// flap when sinking below the middle of the next gap
+struct SimPoolRun {
+    SimBatch *b;
+    unsigned char *actions;
+};
+static void SimPool_run_chunk(void *ctx,int from,int to) {
+    SimPoolRun *r = (SimPoolRun*) ctx;
+    SimBatch *b = r->b;
+    MetricsShard *met = Metrics_local();
+    for(int i=from;i<to;++i) {
+        if(b->done[i]) {
+            Metrics_episode(met,b->point[i],b->y[i]);
+            SimBatch_start(b,i,b->rng[i]);
+        }
+        int next = W, up = H/2;
+        for(int z=0;z<SimPipes;++z) {
+            int x = b->pipe_x[z][i];
+            if(x+SimPipeW>SimBirdX && x<next) {
+                next = x;
+                up = b->pipe_up[z][i];
+            }
+        }
+        r->actions[i] = b->vy[i]>=0 && b->y[i]+SimBirdH>up+SimSpace-SimBirdH/2;
+    }
+    SimBatch_step_range(b,r->actions,from,to);
+    Metrics_ticks(met,to-from);
+}
+int SimPool_run(int worlds,int threads,int chunk,int ticks) {
+    SimPool p;
+    SimBatch b;
+    SimPool_init(&p,threads,chunk);
+    SimBatch_init(&b,worlds);
+    for(int z=0;z<worlds;++z) SimBatch_start(&b,z,z+1);
+    SimPoolRun r = {&b,(unsigned char*) calloc(worlds,1)};
+    SimClock::time_point t0 = SimClock::now();
+    for(int z=0;z<ticks;++z) SimPool_for(&p,worlds,SimPool_run_chunk,&r);
+    SimPool_report(&p,Sim_seconds(t0));
+    free(r.actions);
+    SimBatch_destroy(&b);
+    SimPool_destroy(&p);
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef SIM_POOL_H
+#define SIM_POOL_H
+
+#include "sim.h"
+
+// thread pool for big SimBatch runs
+// work is cut in chunks, each thread starts on its own contiguous share of
+// chunks and steals from the back of the others' shares once it runs dry
+struct SimPoolThread;
+struct SimPoolShared;
+struct SimPool {
+    int threads, chunk;
+    SimPoolThread *th;
+    SimPoolShared *sh;
+};
+struct SimPoolStat {
+    unsigned long long items, steals; // worlds stepped, chunks stolen
+    double busy; // seconds spent running chunks
+};
+typedef void (*SimPoolFn)(void *ctx,int from,int to);
+
+// threads<=0 uses every core, the calling thread counts as thread 0
+void SimPool_init(SimPool *p,int threads,int chunk);
+void SimPool_destroy(SimPool *p);
+// run fn over items 0..n-1 in chunks, returns when every chunk is done
+void SimPool_for(SimPool *p,int n,SimPoolFn fn,void *ctx);
+// one tick for every world of the batch
+void SimPool_step(SimPool *p,SimBatch *b,const unsigned char *actions);
+void SimPool_stat(const SimPool *p,int t,SimPoolStat *st);
+void SimPool_report(const SimPool *p,double wall);
+// headless benchmark: worlds flown by a simple autopilot, restarted on crash
+int SimPool_run(int worlds,int threads,int chunk,int ticks);
+
+#endif // SIM_POOL_H
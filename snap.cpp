@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "snap.h"
+
+static_assert(sizeof(SimSnap)<=60,"SimSnap grew");
+
+void SimSnap_save(SimSnap *s,const SimWorld *w) {
+    s->seed = w->seed;
+    s->rng = w->rng;
+    s->tick = w->tick;
+    s->point = w->point;
+    s->y = w->y;
+    s->vy = w->vy;
+    s->scroll = w->scroll;
+    for(int z=0;z<w->pipes;++z) {
+        s->pipe_x[z] = w->pipe_x[z];
+        s->pipe_up[z] = w->pipe_up[z];
+    }
+    s->pipes = w->pipes;
+    s->head = w->head;
+    s->near = w->near;
+    s->flags = (w->show_pipe ? SimSnapPipe : 0) | (w->done ? SimSnapDone : 0);
+}
+void SimSnap_load(const SimSnap *s,SimWorld *w) {
+    w->seed = s->seed;
+    w->rng = s->rng;
+    w->tick = s->tick;
+    w->point = s->point;
+    w->y = s->y;
+    w->vy = s->vy;
+    w->scroll = s->scroll;
+    for(int z=0;z<s->pipes;++z) {
+        w->pipe_x[z] = s->pipe_x[z];
+        w->pipe_up[z] = s->pipe_up[z];
+    }
+    w->pipes = s->pipes;
+    w->head = s->head;
+    w->near = s->near;
+    w->show_pipe = (s->flags & SimSnapPipe)!=0;
+    w->done = (s->flags & SimSnapDone)!=0;
+}
+
+union SimSnapSlot {
+    SimSnap s;
+    SimSnapSlot *next; // while on the free list
+};
+struct SimSnapBlock {
+    SimSnapBlock *next;
+    SimSnapSlot slot[SimSnapChunk];
+};
+
+static SimSnapBlock *SimSnapArena_block(SimSnapArena *a) {
+    SimSnapBlock *b = (SimSnapBlock*) malloc(sizeof(SimSnapBlock));
+    if(!b) {
+        puts("Out of memory for snapshots");
+        exit(4);
+    }
+    b->next = 0;
+    ++a->chunks;
+    return b;
+}
+void SimSnapArena_init(SimSnapArena *a,size_t reserve) {
+    a->chunks = 0;
+    a->first = a->cur = SimSnapArena_block(a);
+    for(SimSnapBlock *b=a->first;a->chunks*SimSnapChunk<reserve;b=b->next) b->next = SimSnapArena_block(a);
+    SimSnapArena_reset(a);
+}
+void SimSnapArena_destroy(SimSnapArena *a) {
+    for(SimSnapBlock *b=a->first,*n;b;b=n) {
+        n = b->next;
+        free(b);
+    }
+    a->first = a->cur = 0;
+}
+SimSnap *SimSnapArena_alloc(SimSnapArena *a) {
+    ++a->live;
+    if(a->free) {
+        SimSnapSlot *s = a->free;
+        a->free = s->next;
+        return &s->s;
+    }
+    if(a->used==SimSnapChunk) {
+        if(!a->cur->next) a->cur->next = SimSnapArena_block(a);
+        a->cur = a->cur->next;
+        a->used = 0;
+    }
+    return &a->cur->slot[a->used++].s;
+}
+void SimSnapArena_free(SimSnapArena *a,SimSnap *s) {
+    SimSnapSlot *slot = (SimSnapSlot*) s;
+    slot->next = a->free;
+    a->free = slot;
+    --a->live;
+}
+void SimSnapArena_reset(SimSnapArena *a) {
+    a->cur = a->first;
+    a->used = 0;
+    a->free = 0;
+    a->live = 0;
+}
+SimSnap *SimSnapArena_save(SimSnapArena *a,const SimWorld *w) {
+    SimSnap *s = SimSnapArena_alloc(a);
+    SimSnap_save(s,w);
+    return s;
+}
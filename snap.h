@@ -0,0 +1,41 @@
+#ifndef SNAP_H
+#define SNAP_H
+
+#include <stddef.h>
+
+#include "sim.h"
+
+// world snapshots for tree search
+// a SimWorld is the whole game state, SimSnap packs it into 60 bytes, save
+// and load are a handful of stores
+struct SimSnap {
+    unsigned seed, rng, tick;
+    int point;
+    short y, vy, scroll;
+    short pipe_x[SimMaxPipes], pipe_up[SimMaxPipes];
+    unsigned char pipes, head, near;
+    unsigned char flags; // SimSnapPipe, SimSnapDone
+};
+enum ESimSnap { SimSnapPipe = 1, SimSnapDone = 2, SimSnapChunk = 4096 };
+void SimSnap_save(SimSnap *s,const SimWorld *w);
+void SimSnap_load(const SimSnap *s,SimWorld *w);
+
+// snapshots in chunks of SimSnapChunk that never move, so pointers stay
+// valid; freed snapshots are reused first, reset frees every snapshot but
+// keeps the chunks, so a search that fits its reserve never calls malloc
+union SimSnapSlot;
+struct SimSnapBlock;
+struct SimSnapArena {
+    SimSnapBlock *first, *cur; // chunk list, chunk being filled
+    int used; // slots taken in cur
+    SimSnapSlot *free;
+    size_t live, chunks;
+};
+void SimSnapArena_init(SimSnapArena *a,size_t reserve);
+void SimSnapArena_destroy(SimSnapArena *a);
+SimSnap *SimSnapArena_alloc(SimSnapArena *a);
+void SimSnapArena_free(SimSnapArena *a,SimSnap *s);
+void SimSnapArena_reset(SimSnapArena *a);
+SimSnap *SimSnapArena_save(SimSnapArena *a,const SimWorld *w);
+
+#endif // SNAP_H
@@ -0,0 +1,26 @@
+#include "sound_queue.h"
+
+using namespace std;
+
+void SoundQueue_init(SoundQueue *q) {
+    q->head.store(0,memory_order_relaxed);
+    q->tail.store(0,memory_order_relaxed);
+    q->dropped = 0;
+}
+bool SoundQueue_push(SoundQueue *q,unsigned char ev) {
+    unsigned t = q->tail.load(memory_order_relaxed);
+    if(t-q->head.load(memory_order_acquire)==SoundQueueCap) {
+        ++q->dropped;
+        return false;
+    }
+    q->ev[t&(SoundQueueCap-1)] = ev;
+    q->tail.store(t+1,memory_order_release);
+    return true;
+}
+int SoundQueue_pop(SoundQueue *q) {
+    unsigned h = q->head.load(memory_order_relaxed);
+    if(h==q->tail.load(memory_order_acquire)) return -1;
+    int ev = q->ev[h&(SoundQueueCap-1)];
+    q->head.store(h+1,memory_order_release);
+    return ev;
+}
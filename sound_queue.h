@@ -0,0 +1,23 @@
+#ifndef SOUND_QUEUE_H
+#define SOUND_QUEUE_H
+
+#include <atomic>
+
+// sound event ring
+// one producer (the game thread) and one consumer (the audio thread), each
+// side writes only its own index, so neither ever takes a lock or waits
+enum ESoundQueue { SoundQueueCap = 64 }; // power of two
+struct SoundQueue {
+    std::atomic<unsigned> head; // next to pop, written by the consumer
+    char pad[60]; // keep the indices on separate cache lines
+    std::atomic<unsigned> tail; // next to push, written by the producer
+    unsigned dropped; // producer side, events lost to a full ring
+    unsigned char ev[SoundQueueCap];
+};
+void SoundQueue_init(SoundQueue *q);
+// false when the ring is full, the event is dropped
+bool SoundQueue_push(SoundQueue *q,unsigned char ev);
+// -1 when empty
+int SoundQueue_pop(SoundQueue *q);
+
+#endif // SOUND_QUEUE_H
@@ -0,0 +1,408 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+
+#include <SDL2/SDL_net.h>
+
+#include "spectate.h"
+#include "metrics.h"
+
+using namespace std;
+
+typedef chrono::steady_clock SpecClock;
+
+static const char SpecMagic[5] = {'F','L','P','S',1};
+static const char SpecHello[4] = {'F','L','P','H'};
+enum ESpecLimit { SpecMaxGames = 4096 };
+
+static double Spec_seconds(SpecClock::time_point from) {
+    return chrono::duration<double>(SpecClock::now()-from).count();
+}
+double Spec_now() {
+    return chrono::duration<double>(SpecClock::now().time_since_epoch()).count();
+}
+static unsigned char *Spec_put(unsigned char *p,unsigned v) {
+    for(;v>=0x80;v>>=7) *p++ = (unsigned char)(v|0x80);
+    *p++ = (unsigned char)v;
+    return p;
+}
+static unsigned Spec_zig(int v) { return ((unsigned)v<<1) ^ (unsigned)(v>>31); }
+static int Spec_unzig(unsigned v) { return (int)(v>>1) ^ -(int)(v&1); }
+
+// reading past the end sets p to 0
+struct SpecCur {
+    const unsigned char *p, *end;
+};
+static unsigned Spec_get(SpecCur *c) {
+    unsigned v = 0;
+    for(int s=0;c->p && s<35;s+=7) {
+        if(c->p>=c->end) break;
+        unsigned char b = *c->p++;
+        v |= (unsigned)(b&0x7f)<<s;
+        if(!(b&0x80)) return v;
+    }
+    c->p = 0;
+    return 0;
+}
+static int Spec_get_int(SpecCur *c) { return Spec_unzig(Spec_get(c)); }
+
+// pipes of slots past the old count are sent from 0
+static int Spec_old(const int *v,int n,int z) { return z<n ? v[z] : 0; }
+
+// one game, deltas from l unless full, at most SpecGameMax bytes
+static unsigned char *Spec_game(unsigned char *p,const SimWorld *w,const SimWorld *l,bool full) {
+    if(full) {
+        p = Spec_put(p,SpecFull);
+        p = Spec_put(p,Spec_zig(w->y));
+        p = Spec_put(p,w->scroll);
+        p = Spec_put(p,w->point);
+        p = Spec_put(p,w->show_pipe);
+        p = Spec_put(p,w->pipes);
+        for(int z=0;z<w->pipes;++z) {
+            p = Spec_put(p,Spec_zig(w->pipe_x[z]));
+            p = Spec_put(p,Spec_zig(w->pipe_up[z]));
+        }
+        return p;
+    }
+    // pipes usually all scroll by the same step and only need it once
+    int d = w->pipes ? w->pipe_x[0]-l->pipe_x[0] : 0;
+    bool shift = w->pipes==l->pipes;
+    for(int z=0;shift && z<w->pipes;++z)
+        shift = w->pipe_x[z]-l->pipe_x[z]==d && w->pipe_up[z]==l->pipe_up[z];
+    unsigned mask = 0;
+    if(w->y!=l->y) mask |= SpecY;
+    if(w->scroll!=l->scroll) mask |= SpecScroll;
+    if(w->point!=l->point) mask |= SpecPoint;
+    if(w->show_pipe!=l->show_pipe) mask |= SpecShow;
+    if(!shift) mask |= SpecPipes;
+    else if(d) mask |= SpecShift;
+    p = Spec_put(p,mask);
+    if(mask&SpecY) p = Spec_put(p,Spec_zig(w->y-l->y));
+    if(mask&SpecScroll) p = Spec_put(p,Spec_zig(w->scroll-l->scroll));
+    if(mask&SpecPoint) p = Spec_put(p,Spec_zig(w->point-l->point));
+    if(mask&SpecShow) p = Spec_put(p,w->show_pipe);
+    if(mask&SpecShift) p = Spec_put(p,Spec_zig(d));
+    if(mask&SpecPipes) {
+        p = Spec_put(p,w->pipes);
+        for(int z=0;z<w->pipes;++z) {
+            p = Spec_put(p,Spec_zig(w->pipe_x[z]-Spec_old(l->pipe_x,l->pipes,z)));
+            p = Spec_put(p,Spec_zig(w->pipe_up[z]-Spec_old(l->pipe_up,l->pipes,z)));
+        }
+    }
+    return p;
+}
+// applies one game to t, returns its mask, c->p is 0 when damaged
+static unsigned Spec_read_game(SpecCur *c,SimWorld *t) {
+    unsigned mask = Spec_get(c);
+    if(mask&SpecFull) {
+        t->y = Spec_get_int(c);
+        t->scroll = Spec_get(c);
+        t->point = Spec_get(c);
+        t->show_pipe = Spec_get(c)!=0;
+        t->pipes = 0;
+        mask |= SpecPipes;
+    } else {
+        if(mask&SpecY) t->y += Spec_get_int(c);
+        if(mask&SpecScroll) t->scroll += Spec_get_int(c);
+        if(mask&SpecPoint) t->point += Spec_get_int(c);
+        if(mask&SpecShow) t->show_pipe = Spec_get(c)!=0;
+        if(mask&SpecShift) {
+            int d = Spec_get_int(c);
+            for(int z=0;z<t->pipes;++z) t->pipe_x[z] += d;
+        }
+    }
+    if(mask&SpecPipes) {
+        unsigned n = Spec_get(c);
+        if(n>SimMaxPipes) {
+            c->p = 0;
+            return 0;
+        }
+        for(unsigned z=0;z<n;++z) {
+            t->pipe_x[z] = Spec_old(t->pipe_x,t->pipes,z)+Spec_get_int(c);
+            t->pipe_up[z] = Spec_old(t->pipe_up,t->pipes,z)+Spec_get_int(c);
+        }
+        t->pipes = n;
+    }
+    return mask;
+}
+
+void SpecWriter_init(SpecWriter *sw,int games,int variant) {
+    sw->last.assign(games,SimWorld());
+    sw->buf.clear();
+    sw->end.clear();
+    sw->variant = variant;
+}
+void SpecWriter_tick(SpecWriter *sw,const SimWorld *w,int n,unsigned tick,bool key) {
+    sw->buf.clear();
+    sw->end.clear();
+    size_t start = 0;
+    for(int g=0;g<n;++g) {
+        unsigned char tmp[SpecGameMax], *p = tmp;
+        SimWorld *l = &sw->last[g];
+        p = Spec_game(p,w+g,l,key || w[g].tick!=l->tick+1); // restarted games go in full
+        *l = w[g];
+        if(g==0 || sw->buf.size()-start+(p-tmp)>SpecMtu) {
+            if(g) sw->end.push_back(sw->buf.size());
+            start = sw->buf.size();
+            unsigned char head[sizeof(SpecMagic)+15], *h = head+sizeof(SpecMagic);
+            memcpy(head,SpecMagic,sizeof(SpecMagic));
+            h = Spec_put(h,tick);
+            h = Spec_put(h,sw->variant);
+            h = Spec_put(h,g);
+            sw->buf.insert(sw->buf.end(),head,h);
+        }
+        sw->buf.insert(sw->buf.end(),tmp,p);
+    }
+    if(n) sw->end.push_back(sw->buf.size());
+}
+int SpecWriter_count(const SpecWriter *sw) {
+    return sw->end.size();
+}
+const unsigned char *SpecWriter_dgram(const SpecWriter *sw,int z,int *len) {
+    size_t from = z ? sw->end[z-1] : 0;
+    *len = sw->end[z]-from;
+    return &sw->buf[from];
+}
+
+void SpecView_init(SpecView *v) {
+    v->w.clear();
+    v->ok.clear();
+    v->variant = -1;
+    v->dgrams = v->held = 0;
+}
+bool SpecView_read(SpecView *v,const unsigned char *p,int len) {
+    if(len<(int)sizeof(SpecMagic) || memcmp(p,SpecMagic,sizeof(SpecMagic))) return false;
+    SpecCur c = {p+sizeof(SpecMagic),p+len};
+    unsigned tick = Spec_get(&c), variant = Spec_get(&c), g = Spec_get(&c);
+    if(!c.p || variant>=(unsigned)SimVariantCount || (v->variant>=0 && (int)variant!=v->variant)) return false;
+    v->variant = variant;
+    ++v->dgrams;
+    for(;c.p && c.p<c.end;++g) {
+        if(g>=SpecMaxGames) return false;
+        if(g>=v->w.size()) {
+            v->w.resize(g+1,SimWorld());
+            v->ok.resize(g+1,0);
+        }
+        SimWorld t = v->w[g];
+        unsigned mask = Spec_read_game(&c,&t);
+        if(!c.p) return false;
+        if((mask&SpecFull) || (v->ok[g] && v->w[g].tick+1==tick)) {
+            t.tick = tick;
+            v->w[g] = t;
+            v->ok[g] = 1;
+        } else ++v->held; // a datagram of this game was lost
+    }
+    return true;
+}
+
+bool SpecSocket_open(SpecSocket *s,const char *host,int port) {
+    memset(s,0,sizeof(SpecSocket));
+    if(SDLNet_Init()) { // 1
+        printf("SDLNet_Init Error: %s\n",SDLNet_GetError());
+        return false;
+    }
+    IPaddress srv;
+    if(SDLNet_ResolveHost(&srv,host,port) || !(s->sock = SDLNet_UDP_Open(0))) { // 2
+        printf("Failed to reach '%s': %s\n",host,SDLNet_GetError());
+        SDLNet_Quit(); // ~1
+        return false;
+    }
+    s->in = SDLNet_AllocPacket(SpecMtu); // 3
+    s->hello = SDLNet_AllocPacket(sizeof(SpecHello));
+    memcpy(s->hello->data,SpecHello,sizeof(SpecHello));
+    s->hello->len = sizeof(SpecHello);
+    s->hello->address = srv;
+    s->set = SDLNet_AllocSocketSet(1); // 4
+    SDLNet_UDP_AddSocket(s->set,s->sock);
+    s->hello_t = 0;
+    return true;
+}
+void SpecSocket_close(SpecSocket *s) {
+    SDLNet_FreeSocketSet(s->set); // ~4
+    SDLNet_FreePacket(s->hello); // ~3
+    SDLNet_FreePacket(s->in);
+    SDLNet_UDP_Close(s->sock); // ~2
+    SDLNet_Quit(); // ~1
+}
+int SpecSocket_poll(SpecSocket *s,SpecView *v,int ms) {
+    double now = Spec_now();
+    if(now>=s->hello_t) {
+        SDLNet_UDP_Send(s->sock,-1,s->hello);
+        s->hello_t = now+1;
+    }
+    if(ms>0 && SDLNet_CheckSockets(s->set,ms)<=0) return 0;
+    int n = 0;
+    while(SDLNet_UDP_Recv(s->sock,s->in)>0) n += SpecView_read(v,s->in->data,s->in->len);
+    return n;
+}
+
+struct SpecPeer {
+    IPaddress addr;
+    unsigned seen; // tick of the last hello
+};
+// true when a new spectator joined
+static bool Spec_hello(vector<SpecPeer> *cl,const UDPpacket *in,unsigned tick) {
+    if(in->len<(int)sizeof(SpecHello) || memcmp(in->data,SpecHello,sizeof(SpecHello))) return false;
+    for(size_t z=0;z<cl->size();++z)
+        if((*cl)[z].addr.host==in->address.host && (*cl)[z].addr.port==in->address.port) {
+            (*cl)[z].seen = tick;
+            return false;
+        }
+    if(cl->size()>=SpecMaxClients) return false;
+    SpecPeer c = {in->address,tick};
+    cl->push_back(c);
+    return true;
+}
+static void Spec_drop(vector<SpecPeer> *cl,unsigned tick,unsigned timeout) {
+    size_t k = 0;
+    for(size_t z=0;z<cl->size();++z)
+        if(tick-(*cl)[z].seen<timeout) (*cl)[k++] = (*cl)[z];
+    cl->resize(k);
+}
+int Spec_serve(const SimVariant *var,int port,int games,int seconds) {
+    if(games<1 || games>SpecMaxGames) {
+        printf("--games must be 1..%d\n",(int)SpecMaxGames);
+        return 1;
+    }
+    if(SDLNet_Init()) { // 1
+        printf("SDLNet_Init Error: %s\n",SDLNet_GetError());
+        return 1;
+    }
+    UDPsocket sock = SDLNet_UDP_Open(port); // 2
+    if(!sock) {
+        printf("Failed to open UDP port %d: %s\n",port,SDLNet_GetError());
+        SDLNet_Quit(); // ~1
+        return 1;
+    }
+    UDPpacket *in = SDLNet_AllocPacket(SpecMtu), *out = SDLNet_AllocPacket(SpecMtu); // 3
+    SDLNet_SocketSet set = SDLNet_AllocSocketSet(1); // 4
+    SDLNet_UDP_AddSocket(set,sock);
+    vector<SimWorld> w(games);
+    for(int g=0;g<games;++g) var->start(&w[g],g+1);
+    SpecWriter sw;
+    SpecWriter_init(&sw,games,var-SimVariants);
+    vector<SpecPeer> cl;
+    MetricsShard *met = Metrics_local();
+    printf("Serving %d %s games on UDP port %d\n",games,var->name,port);
+    const double step = 1.0/var->fps;
+    const unsigned report = 5*var->fps;
+    SpecClock::time_point t0 = SpecClock::now();
+    double ser = 0, send = 0;
+    unsigned long long bytes = 0, sent = 0;
+    bool joined = false;
+    for(unsigned tick=0;!seconds || tick<(unsigned)seconds*var->fps;++tick) {
+        for(double wait;;) { // hellos until the tick is due
+            while(SDLNet_UDP_Recv(sock,in)>0) joined |= Spec_hello(&cl,in,tick);
+            if((wait = tick*step-Spec_seconds(t0))<=0 || SDLNet_CheckSockets(set,(Uint32)(wait*1000)+1)<=0) break;
+        }
+        Spec_drop(&cl,tick,SpecTimeout*var->fps);
+        for(int g=0;g<games;++g) {
+            if(w[g].done) {
+                Metrics_episode(met,w[g].point,w[g].y);
+                var->start(&w[g],w[g].rng);
+            }
+            var->step(&w[g],var->autopilot(&w[g]));
+        }
+        Metrics_ticks(met,games);
+        SpecClock::time_point s0 = SpecClock::now();
+        SpecWriter_tick(&sw,&w[0],games,tick,tick%SpecKeyEvery==0 || joined);
+        joined = false;
+        ser += Spec_seconds(s0);
+        s0 = SpecClock::now();
+        for(int z=0;z<SpecWriter_count(&sw);++z) {
+            int len;
+            const unsigned char *d = SpecWriter_dgram(&sw,z,&len);
+            memcpy(out->data,d,len);
+            out->len = len;
+            bytes += len;
+            for(size_t k=0;k<cl.size();++k) {
+                out->address = cl[k].addr;
+                sent += SDLNet_UDP_Send(sock,-1,out);
+            }
+        }
+        send += Spec_seconds(s0);
+        if(tick%report==report-1) {
+            printf("%d spectators, %.1f datagrams %.0f bytes per tick, serialize %.1fus send %.1fus per tick, %llu sent\n",
+                   (int)cl.size(),(double)SpecWriter_count(&sw),(double)bytes/report,ser/report*1e6,send/report*1e6,sent);
+            ser = send = 0;
+            bytes = sent = 0;
+        }
+    }
+    SDLNet_FreeSocketSet(set); // ~4
+    SDLNet_FreePacket(out); // ~3
+    SDLNet_FreePacket(in);
+    SDLNet_UDP_Close(sock); // ~2
+    SDLNet_Quit(); // ~1
+    return 0;
+}
+
+int Spec_load(const char *host,int port,int clients,int seconds) {
+    if(clients<1 || clients>SpecMaxClients) {
+        printf("--clients must be 1..%d\n",(int)SpecMaxClients);
+        return 1;
+    }
+    if(SDLNet_Init()) { // 1
+        printf("SDLNet_Init Error: %s\n",SDLNet_GetError());
+        return 1;
+    }
+    IPaddress srv;
+    if(SDLNet_ResolveHost(&srv,host,port)) {
+        printf("Failed to resolve '%s': %s\n",host,SDLNet_GetError());
+        SDLNet_Quit(); // ~1
+        return 1;
+    }
+    UDPpacket *in = SDLNet_AllocPacket(SpecMtu), *hello = SDLNet_AllocPacket(sizeof(SpecHello)); // 2
+    memcpy(hello->data,SpecHello,sizeof(SpecHello));
+    hello->len = sizeof(SpecHello);
+    hello->address = srv;
+    SDLNet_SocketSet set = SDLNet_AllocSocketSet(clients); // 3
+    vector<UDPsocket> sock;
+    vector<SpecView> v(clients);
+    for(int z=0;z<clients;++z) {
+        UDPsocket s = SDLNet_UDP_Open(0); // 4
+        if(!s) {
+            printf("Failed to open socket %d: %s\n",z,SDLNet_GetError());
+            break;
+        }
+        sock.push_back(s);
+        SDLNet_UDP_AddSocket(set,s);
+        SpecView_init(&v[z]);
+    }
+    SpecClock::time_point t0 = SpecClock::now();
+    unsigned long long bytes = 0, bad = 0;
+    for(double hello_t = 0;Spec_seconds(t0)<seconds;) {
+        if(Spec_seconds(t0)>=hello_t) {
+            for(size_t z=0;z<sock.size();++z) SDLNet_UDP_Send(sock[z],-1,hello);
+            hello_t += 1;
+        }
+        if(SDLNet_CheckSockets(set,100)<=0) continue;
+        for(size_t z=0;z<sock.size();++z) {
+            if(!SDLNet_SocketReady(sock[z])) continue;
+            while(SDLNet_UDP_Recv(sock[z],in)>0) {
+                bytes += in->len;
+                if(!SpecView_read(&v[z],in->data,in->len)) ++bad;
+            }
+        }
+    }
+    double sec = Spec_seconds(t0);
+    int synced = 0;
+    unsigned long long dgrams = 0, held = 0;
+    for(size_t z=0;z<sock.size();++z) {
+        bool ok = !v[z].ok.empty();
+        for(size_t g=0;g<v[z].ok.size();++g) ok = ok && v[z].ok[g];
+        synced += ok;
+        dgrams += v[z].dgrams;
+        held += v[z].held;
+        SDLNet_UDP_Close(sock[z]); // ~4
+    }
+    int n = sock.size();
+    printf("%d spectators, %d synced on every game, %.0f datagrams/s %.1f KB/s each, "
+           "%llu games held after a loss, %llu bad datagrams\n",
+           n,synced,n ? dgrams/sec/n : 0.0,n ? bytes/sec/n/1024 : 0.0,held,bad);
+    SDLNet_FreeSocketSet(set); // ~3
+    SDLNet_FreePacket(hello); // ~2
+    SDLNet_FreePacket(in);
+    SDLNet_Quit(); // ~1
+    return n==clients && synced==n ? 0 : 2;
+}
@@ -0,0 +1,74 @@
+#ifndef SPECTATE_H
+#define SPECTATE_H
+
+#include <stddef.h>
+
+#include <vector>
+
+#include <SDL2/SDL_net.h>
+
+#include "sim.h"
+
+// spectator stream
+// the server runs games headless with the autopilot and sends every tick
+// to every subscribed spectator over UDP; a tick is serialized once into
+// datagrams of at most SpecMtu bytes that are shared by all spectators, so
+// serializing costs the same for 1 or 1000 of them
+// datagram: "FLPS" version, then LEB128: tick, variant, first game, then
+// games up to the end of the datagram, each a field mask and the changed
+// fields as zigzag deltas from the previous tick (absolute with SpecFull)
+// every SpecKeyEvery ticks, on a join and for a restarted game the state
+// is sent in full; a spectator that lost a datagram holds those games
+// until their next full state
+// spectators subscribe with "FLPH" and repeat it every second, silent
+// ones are dropped after SpecTimeout seconds
+enum ESpec { SpecPort = 7654, SpecMtu = 1200, SpecGameMax = 128, SpecKeyEvery = 32,
+             SpecMaxClients = 1024, SpecTimeout = 5 };
+enum ESpecField { SpecY = 1, SpecScroll = 2, SpecPoint = 4, SpecShow = 8, SpecShift = 16,
+                  SpecPipes = 32, SpecFull = 64 };
+
+struct SpecWriter {
+    std::vector<SimWorld> last; // previous tick of every game
+    std::vector<unsigned char> buf; // datagrams of the current tick
+    std::vector<size_t> end; // end of each datagram in buf
+    int variant; // index in SimVariants
+};
+void SpecWriter_init(SpecWriter *sw,int games,int variant);
+// key sends every game in full
+void SpecWriter_tick(SpecWriter *sw,const SimWorld *w,int n,unsigned tick,bool key);
+int SpecWriter_count(const SpecWriter *sw);
+const unsigned char *SpecWriter_dgram(const SpecWriter *sw,int z,int *len);
+
+// spectator side copy of the games, only the drawn fields are kept and
+// tick is the last tick applied
+struct SpecView {
+    std::vector<SimWorld> w;
+    std::vector<unsigned char> ok; // 0 until a full state arrived
+    int variant; // -1 until the first datagram
+    unsigned long long dgrams, held; // held: games skipped after a loss
+};
+void SpecView_init(SpecView *v);
+// false for a damaged or foreign datagram
+bool SpecView_read(SpecView *v,const unsigned char *p,int len);
+
+// one spectator, subscribed to a server until closed
+struct SpecSocket {
+    UDPsocket sock;
+    UDPpacket *in, *hello;
+    SDLNet_SocketSet set;
+    double hello_t; // next hello, Spec_now clock
+};
+double Spec_now();
+bool SpecSocket_open(SpecSocket *s,const char *host,int port);
+void SpecSocket_close(SpecSocket *s);
+// repeats the hello when due and reads every waiting datagram into v,
+// waiting up to ms for the first one, returns the datagrams read
+int SpecSocket_poll(SpecSocket *s,SpecView *v,int ms);
+
+// server, seconds 0 runs until killed
+int Spec_serve(const SimVariant *var,int port,int games,int seconds);
+// headless load test: clients spectators on one host, each decoding every
+// game, reports datagrams, bytes and games held after losses
+int Spec_load(const char *host,int port,int clients,int seconds);
+
+#endif // SPECTATE_H